@@ -2,6 +2,10 @@
 #define AST_H_INCLUDE
 
 #include "Token.h"
+#include "Arena.h"
+#include "Builtins.h"
+#include "Value.h"
+#include <string>
 #include <vector>
 
 class AST
@@ -15,7 +19,17 @@ public:
     NUMBER,
     VARIABLE,
     COMPOUND,
-    ASSIGN
+    ASSIGN,
+    OP_POWER,
+    OP_VAR_CONST,
+    OP_VAR_VAR,
+    OP_MUL_ADD,
+    CALL,
+    WHILE,
+    FOR,
+    HOISTED,
+    INDUCTION,
+    STEP
   };
 
   static std::string fromType(const AST::Type& t)
@@ -36,14 +50,59 @@ public:
         return "COMPOUND";
       case AST::ASSIGN:
         return "ASSIGN";
+      case AST::OP_POWER:
+        return "POWER OP";
+      case AST::OP_VAR_CONST:
+        return "VAR CONST OP";
+      case AST::OP_VAR_VAR:
+        return "VAR VAR OP";
+      case AST::OP_MUL_ADD:
+        return "MUL ADD OP";
+      case AST::CALL:
+        return "CALL";
+      case AST::WHILE:
+        return "WHILE";
+      case AST::FOR:
+        return "FOR";
+      case AST::HOISTED:
+        return "HOISTED";
+      case AST::INDUCTION:
+        return "INDUCTION";
+      case AST::STEP:
+        return "STEP";
     }
     return "??";
   }
 
-  AST() {};
+  AST() : kind(Value::NONE), cost(0) {};
   virtual ~AST() {};
 
+  static void* operator new(std::size_t n) { return Arena::create(n); };
+  static void operator delete(void* p) { Arena::destroy(p); };
+
   virtual AST::Type getType() const = 0;
+
+  // A copy of the tree below this node, to optimize while the original
+  // runs. Only the nodes the Parser builds can be copied.
+  virtual AST* clone() const
+  {
+    throw std::string("AST: can't copy a ") + fromType(getType());
+  };
+
+  // the statically inferred kind of value this node evaluates to, NONE when
+  // it can only be known at run time
+  inline Value::Kind getKind() const { return kind; };
+  inline void setKind(const Value::Kind k) { kind = k; };
+  // how many nodes of the parsed program running a statement, or testing a
+  // loop's condition, evaluates; what it's charged against a Budget
+  inline uint32_t getCost() const { return cost; };
+  inline void setCost(const uint32_t c) { cost = c; };
+protected:
+  // n, with the same kind and cost as this node
+  AST* copied(AST* n) const { n->setKind(kind); n->setCost(cost); return n; };
+private:
+  Value::Kind kind;
+  uint32_t cost;
 };
 
 class NoOp : public AST
@@ -53,6 +112,7 @@ public:
   ~NoOp() {};
 
   virtual AST::Type getType() const { return AST::NO_OP; };
+  virtual AST* clone() const { return copied(new NoOp()); };
 };
 
 class UnaryOp : public AST
@@ -62,8 +122,10 @@ public:
   ~UnaryOp() { delete op; delete node; };
 
   virtual AST::Type getType() const { return AST::OP_UNARY; };
+  virtual AST* clone() const { return copied(new UnaryOp(op->clone(), node->clone())); };
   inline Token::Type tokenType() const { return op->getType(); };
   inline AST* const& getNode() const { return node; };
+  inline void setNode(AST* n) { node = n; };
 private:
   Token* op;
   AST* node;
@@ -76,9 +138,12 @@ public:
   virtual ~BinaryOp() { delete left; delete op; delete right; };
 
   virtual AST::Type getType() const { return AST::OP_BINARY; };
+  virtual AST* clone() const { return copied(new BinaryOp(left->clone(), op->clone(), right->clone())); };
   inline Token::Type tokenType() const { return op->getType(); };
   inline AST* const& getLeft() const { return left; };
   inline AST* const& getRight() const { return right; };
+  inline void setLeft(AST* l) { left = l; };
+  inline void setRight(AST* r) { right = r; };
 private:
   AST* left;
   Token* op;
@@ -92,8 +157,9 @@ public:
   ~Number() { delete token; };
 
   virtual AST::Type getType() const { return AST::NUMBER; };
+  virtual AST* clone() const { return copied(new Number(token->clone())); };
 
-  double getValue() const { return token->getValue(); };
+  const Value& getValue() const { return token->getValue(); };
 private:
   TokenNumber* token;
 };
@@ -101,27 +167,54 @@ private:
 class Variable : public AST
 {
 public:
-  Variable(Token* t) { token = static_cast<TokenID*>(t); };
+  Variable(Token* t) : slot(0) { token = static_cast<TokenID*>(t); };
   ~Variable() {};
 
   virtual AST::Type getType() const { return AST::VARIABLE; };
+  // shares the name, which lives as long as the original tree
+  virtual AST* clone() const
+  {
+    Variable* v = new Variable(token);
+    v->setSlot(slot);
+    return copied(v);
+  };
   const std::string& getName() const { return token->getName(); };
+  // where the variable lives in its Scope, once resolved
+  inline uint32_t getSlot() const { return slot; };
+  inline void setSlot(const uint32_t s) { slot = s; };
 private:
   TokenID* token;
+  uint32_t slot;
 };
 
 class Compound : public AST
 {
 public:
-  Compound() {};
+  Compound() : frame(0), frameSize(0) {};
   ~Compound() { for (AST* c : children) delete c; };
 
   virtual AST::Type getType() const { return AST::COMPOUND; };
+  virtual AST* clone() const
+  {
+    Compound* c = new Compound();
+    for (AST* child : children)
+      c->add(child->clone());
+    c->setFrame(frame, frameSize);
+    return copied(c);
+  };
 
   void add(AST* node) { children.push_back(node); };
   const std::vector<AST*>& getChildren() const { return children; };
+  void replace(std::vector<AST*>::size_type i, AST* node) { children[i] = node; };
+  // the slots of the block's own variables, once resolved, emptied each
+  // time it's entered
+  inline uint32_t getFrame() const { return frame; };
+  inline uint32_t getFrameSize() const { return frameSize; };
+  inline void setFrame(const uint32_t first, const uint32_t size) { frame = first; frameSize = size; };
 private:
   std::vector<AST*> children;
+  uint32_t frame;
+  uint32_t frameSize;
 };
 
 class Assign : public AST
@@ -131,12 +224,282 @@ public:
   ~Assign() { delete variable; delete op; delete right; };
 
   virtual AST::Type getType() const { return AST::ASSIGN; };
+  virtual AST* clone() const
+  {
+    return copied(new Assign(static_cast<Variable*>(variable->clone()), op->clone(), right->clone()));
+  };
   const std::string& getName() const { return variable->getName(); };
+  inline uint32_t getSlot() const { return variable->getSlot(); };
+  Variable* const& getVariable() const { return variable; };
   AST* const& getRight() const { return right; };
+  void setRight(AST* r) { right = r; };
 private:
   Variable* variable;
   Token* op;
   AST* right;
 };
 
+// x ** e for a constant exponent, built by the Optimizer
+class PowerOp : public AST
+{
+public:
+  enum Kernel
+  {
+    ZERO,       // x ** 0
+    ONE,        // x ** 1
+    SQUARE,     // x ** 2
+    RECIPROCAL, // x ** -1
+    SQRT,       // x ** 0.5
+    INTEGER,    // x ** n, std::pow for doubles
+    SQUARING    // x ** n, repeated squaring for doubles too
+  };
+
+  PowerOp(AST* b, const Kernel k, const int64_t n) : base(b), kernel(k), exponent(n) {};
+  ~PowerOp() { delete base; };
+
+  virtual AST::Type getType() const { return AST::OP_POWER; };
+  inline AST* const& getBase() const { return base; };
+  inline void setBase(AST* b) { base = b; };
+  inline Kernel getKernel() const { return kernel; };
+  inline int64_t getExponent() const { return exponent; };
+private:
+  AST* base;
+  Kernel kernel;
+  int64_t exponent;
+};
+
+// The fused operations the Optimizer builds from common BinaryOp shapes, so
+// they take one visit instead of three.
+
+// `var op const`, or `const op var` when reversed
+class VarConstOp : public AST
+{
+public:
+  VarConstOp(Variable* v, const Token::Type o, const Value& c, const bool r) : variable(v), op(o), constant(c), reversed(r) {};
+  ~VarConstOp() { delete variable; };
+
+  virtual AST::Type getType() const { return AST::OP_VAR_CONST; };
+  inline Token::Type tokenType() const { return op; };
+  inline Variable* const& getVariable() const { return variable; };
+  inline const Value& getConstant() const { return constant; };
+  inline bool isReversed() const { return reversed; };
+private:
+  Variable* variable;
+  Token::Type op;
+  Value constant;
+  bool reversed;
+};
+
+// `var op var`
+class VarVarOp : public AST
+{
+public:
+  VarVarOp(Variable* l, const Token::Type o, Variable* r) : left(l), op(o), right(r) {};
+  ~VarVarOp() { delete left; delete right; };
+
+  virtual AST::Type getType() const { return AST::OP_VAR_VAR; };
+  inline Token::Type tokenType() const { return op; };
+  inline Variable* const& getLeft() const { return left; };
+  inline Variable* const& getRight() const { return right; };
+private:
+  Variable* left;
+  Token::Type op;
+  Variable* right;
+};
+
+// `a * b + c`, with a single rounding when fused
+class MulAddOp : public AST
+{
+public:
+  MulAddOp(AST* a, AST* b, AST* c, const bool f) : multiplier(a), multiplicand(b), addend(c), fused(f) {};
+  ~MulAddOp() { delete multiplier; delete multiplicand; delete addend; };
+
+  virtual AST::Type getType() const { return AST::OP_MUL_ADD; };
+  inline AST* const& getMultiplier() const { return multiplier; };
+  inline AST* const& getMultiplicand() const { return multiplicand; };
+  inline AST* const& getAddend() const { return addend; };
+  inline bool isFused() const { return fused; };
+private:
+  AST* multiplier;
+  AST* multiplicand;
+  AST* addend;
+  bool fused;
+};
+
+// a call of a builtin function
+class Call : public AST
+{
+public:
+  Call(const Builtin* b, const std::vector<AST*>& a) : builtin(b), args(a) {};
+  ~Call() { for (AST* a : args) delete a; };
+
+  virtual AST::Type getType() const { return AST::CALL; };
+  virtual AST* clone() const
+  {
+    std::vector<AST*> a;
+    for (AST* arg : args)
+      a.push_back(arg->clone());
+    return copied(new Call(builtin, a));
+  };
+  inline const Builtin* getBuiltin() const { return builtin; };
+  inline const std::vector<AST*>& getArgs() const { return args; };
+  inline void setArg(std::vector<AST*>::size_type i, AST* a) { args[i] = a; };
+private:
+  const Builtin* builtin;
+  std::vector<AST*> args;
+};
+
+// The nodes the Optimizer builds for loops. They keep state between the
+// iterations of their loop, which forgets it whenever the loop is entered.
+
+// an expression none of whose variables the loop assigns, evaluated the first
+// time it's needed and remembered for the rest of the loop
+class Hoisted : public AST
+{
+public:
+  Hoisted(AST* n) : node(n), valid(false) {};
+  ~Hoisted() { delete node; };
+
+  virtual AST::Type getType() const { return AST::HOISTED; };
+  inline AST* const& getNode() const { return node; };
+  inline void setNode(AST* n) { node = n; };
+
+  inline bool isValid() const { return valid; };
+  inline const Value& getValue() const { return value; };
+  inline void setValue(const Value& v) { value = v; valid = true; };
+  inline void reset() { valid = false; };
+private:
+  AST* node;
+  Value value;
+  bool valid;
+};
+
+// `i * k`, or `k * i` when reversed, i being stepped by a constant and k not
+// changing in the loop. Once the product is known, each step of i adds
+// step * k to it rather than it being multiplied out again. Only exact integer
+// products are kept like this.
+class Induction : public AST
+{
+public:
+  Induction(Variable* v, AST* f, const int64_t s, const bool r) : variable(v), factor(f), step(s), reversed(r), product(0), delta(0), valid(false) {};
+  ~Induction() { delete variable; delete factor; };
+
+  virtual AST::Type getType() const { return AST::INDUCTION; };
+  inline Variable* const& getVariable() const { return variable; };
+  inline AST* const& getFactor() const { return factor; };
+  inline void setFactor(AST* f) { factor = f; };
+  inline int64_t getStep() const { return step; };
+  inline bool isReversed() const { return reversed; };
+
+  inline bool isValid() const { return valid; };
+  inline Value getProduct() const { return Value(product); };
+  // the product was multiplied out, keep it if it's exact (which it can only
+  // be for integer i and k)
+  void start(const Value& k, const Value& p)
+  {
+    valid = p.isInt() && !__builtin_mul_overflow(step, k.toInt(), &delta);
+    if (valid)
+      product = p.toInt();
+  }
+  // i was stepped
+  inline void advance()
+  {
+    if (valid)
+      valid = !__builtin_add_overflow(product, delta, &product);
+  }
+  inline void reset() { valid = false; };
+private:
+  Variable* variable;
+  AST* factor;
+  int64_t step;
+  bool reversed;
+  int64_t product;
+  int64_t delta;
+  bool valid;
+};
+
+// `i = i + step`, advancing the Inductions of i after assigning it
+class Step : public AST
+{
+public:
+  Step(Assign* a) : assign(a) {};
+  ~Step() { delete assign; };
+
+  virtual AST::Type getType() const { return AST::STEP; };
+  inline Assign* const& getAssign() const { return assign; };
+  inline const std::vector<Induction*>& getInductions() const { return inductions; };
+  inline void add(Induction* i) { inductions.push_back(i); };
+private:
+  Assign* assign;
+  std::vector<Induction*> inductions; // owned by the tree below the loop
+};
+
+class Loop : public AST
+{
+public:
+  Loop(AST* c, AST* b) : condition(c), body(b), iterations(0), optimized(nullptr), outer(nullptr) {};
+  virtual ~Loop() { delete condition; delete body; };
+
+  inline AST* const& getCondition() const { return condition; };
+  inline void setCondition(AST* c) { condition = c; };
+  inline AST* const& getBody() const { return body; };
+  inline void setBody(AST* b) { body = b; };
+
+  // the Optimizer's nodes to reset on entering the loop, owned by the tree
+  // below it
+  inline const std::vector<Hoisted*>& getHoisted() const { return hoisted; };
+  inline void add(Hoisted* h) { hoisted.push_back(h); };
+  inline const std::vector<Induction*>& getInductions() const { return inductions; };
+  inline void add(Induction* i) { inductions.push_back(i); };
+
+  // counts an iteration, giving how many there have been
+  inline uint64_t iterate() { return ++iterations; };
+  // this loop in the optimized copy of the tree, if it's been made
+  inline Loop* getOptimized() const { return optimized; };
+  inline void setOptimized(Loop* l) { optimized = l; };
+  // the loop this one's in, if it's in one, set in optimized copies
+  inline Loop* getOuter() const { return outer; };
+  inline void setOuter(Loop* l) { outer = l; };
+private:
+  AST* condition;
+  AST* body;
+  std::vector<Hoisted*> hoisted;
+  std::vector<Induction*> inductions;
+  uint64_t iterations;
+  Loop* optimized;
+  Loop* outer;
+};
+
+// while (condition) body
+class While : public Loop
+{
+public:
+  While(AST* c, AST* b) : Loop(c, b) {};
+  ~While() {};
+
+  virtual AST::Type getType() const { return AST::WHILE; };
+  virtual AST* clone() const { return copied(new While(getCondition()->clone(), getBody()->clone())); };
+};
+
+// for (init; condition; step) body
+class For : public Loop
+{
+public:
+  For(AST* i, AST* c, AST* s, AST* b) : Loop(c, b), init(i), step(s) {};
+  ~For() { delete init; delete step; };
+
+  virtual AST::Type getType() const { return AST::FOR; };
+  virtual AST* clone() const
+  {
+    return copied(new For(init->clone(), getCondition()->clone(), step->clone(), getBody()->clone()));
+  };
+  inline AST* const& getInit() const { return init; };
+  inline void setInit(AST* i) { init = i; };
+  inline AST* const& getStep() const { return step; };
+  inline void setStep(AST* s) { step = s; };
+private:
+  AST* init;
+  AST* step;
+};
+
 #endif
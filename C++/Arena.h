@@ -0,0 +1,144 @@
+#ifndef ARENA_H_INCLUDE
+#define ARENA_H_INCLUDE
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Budget.h"
+
+// A bump allocator for the tokens and nodes of one parse. Anything allocated
+// while an Arena is current on a thread comes from it; deleting such an
+// object runs its destructor but the memory is only given back when the
+// arena goes or is reset. Keeps a tree together in memory, and lets each
+// parser thread allocate without contending on the heap.
+class Arena
+{
+public:
+  Arena(const std::size_t size = 1 << 20) : blockSize(size), used(0), head(nullptr), left(0), limit(nullptr) {};
+  ~Arena() { for (auto&& b : blocks) std::free(b.first); };
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(std::size_t n)
+  {
+    n = (n + ALIGN - 1) & ~(ALIGN - 1);
+    if (limit)
+      limit->take(n);
+    if (n > left)
+      grow(n);
+    void* p = head;
+    head += n;
+    left -= n;
+    return p;
+  }
+
+  // Starts allocating from the beginning again, keeping the memory it has
+  // for reuse. Nothing allocated from it before may be used afterwards.
+  void reset()
+  {
+    used = 0;
+    head = nullptr;
+    left = 0;
+  }
+
+  // How many bytes one or more arenas may allocate between them, past which
+  // allocating throws Budget::Exceeded. Any thread may take from it.
+  class Limit
+  {
+  public:
+    Limit(const std::size_t b) : bytes(b), taken(0) {};
+
+    void take(const std::size_t n)
+    {
+      const std::size_t before = taken.fetch_add(n, std::memory_order_relaxed);
+      if (before > bytes || n > bytes - before)
+        throw Budget::Exceeded(Budget::Exceeded::MEMORY, bytes);
+    }
+
+  private:
+    const std::size_t bytes;
+    std::atomic<std::size_t> taken;
+  };
+
+  // what allocating from it counts against from now on, null for nothing;
+  // it must outlive any allocating while it's set
+  inline void setLimit(Limit* l) { limit = l; };
+
+  // the arena the calling thread allocates from, if any
+  static Arena*& current()
+  {
+    static thread_local Arena* arena = nullptr;
+    return arena;
+  }
+
+  // makes an arena current for the lifetime of the Use
+  class Use
+  {
+  public:
+    Use(Arena* a) : previous(current()) { current() = a; };
+    ~Use() { current() = previous; };
+  private:
+    Arena* previous;
+  };
+
+  // Every object allocated through here is preceded by a word saying where
+  // its memory came from, so it can be released correctly whichever
+  // arena (if any) is current when it's deleted.
+  static void* create(const std::size_t n)
+  {
+    Arena* a = current();
+    uint64_t* p = static_cast<uint64_t*>(a ? a->allocate(n + HEADER) : std::malloc(n + HEADER));
+    if (!p)
+      throw std::bad_alloc();
+    *p = a ? FROM_ARENA : FROM_HEAP;
+    return p + 1;
+  }
+
+  static void destroy(void* ptr)
+  {
+    if (!ptr)
+      return;
+    uint64_t* p = static_cast<uint64_t*>(ptr) - 1;
+    if (*p == FROM_HEAP)
+      std::free(p);
+  }
+
+private:
+  static const std::size_t ALIGN = alignof(uint64_t);
+  static const std::size_t HEADER = sizeof(uint64_t);
+  static const uint64_t FROM_HEAP = 0;
+  static const uint64_t FROM_ARENA = 1;
+
+  // moves on to the next block big enough for n, allocating one if need be
+  void grow(const std::size_t n)
+  {
+    while (used < blocks.size() && blocks[used].second < n)
+      ++used;
+    if (used == blocks.size())
+    {
+      const std::size_t size = n > blockSize ? n : blockSize;
+      char* b = static_cast<char*>(std::malloc(size));
+      if (!b)
+        throw std::bad_alloc();
+      blocks.emplace_back(b, size);
+    }
+    head = blocks[used].first;
+    left = blocks[used].second;
+    ++used;
+  }
+
+  std::size_t blockSize;
+  std::vector<std::pair<char*, std::size_t>> blocks; // and their sizes
+  std::vector<std::pair<char*, std::size_t>>::size_type used; // blocks handed out since the last reset
+  char* head;
+  std::size_t left;
+  Limit* limit;
+};
+
+#endif
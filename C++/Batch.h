@@ -0,0 +1,246 @@
+#ifndef BATCH_H_INCLUDE
+#define BATCH_H_INCLUDE
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "Budget.h"
+#include "Interpreter.h"
+#include "Lexer.h"
+#include "Output.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+
+// Runs many independent scripts in one process. A reader thread loads the
+// files a little ahead of the workers, a fixed pool of workers compiles and
+// runs them, each parsing into an arena of its own that's reused from one
+// script to the next, and the results are written out in the order the
+// scripts were given, whatever order they finish in.
+//
+// Each script's results are preceded by `==> file <==` on a line of its
+// own, or for BINARY by a uint32_t name length, the name and a uint8_t that's
+// 1 if the results follow and 0 if it failed. Errors go to the error stream
+// as `file: message`, also in order.
+class Batch
+{
+public:
+  // threads: how many scripts run at once, 0 for one per core
+  // budget: what each script may use
+  // global: whether every variable is global, see Interpreter::setGlobalScope
+  Batch(const std::vector<std::string>& f, const Output& o, const uint32_t threads = 0, const Optimizer::Options& opt = Optimizer::Options(), const Interpreter::Tiering& t = Interpreter::Tiering(), const Budget& b = Budget(), const bool global = false)
+    : files(f), output(o), options(opt), tiering(t), budget(b), globalScope(global), workers(ThreadPool::threads(threads)), loaded(0), written(0) {};
+  ~Batch() {};
+
+  Batch(const Batch&) = delete;
+  Batch& operator=(const Batch&) = delete;
+
+  // The scripts at path: every regular file in a directory, in name order,
+  // or else a file listing one script per line.
+  static std::vector<std::string> list(const std::string& path)
+  {
+    std::vector<std::string> scripts;
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error))
+    {
+      for (auto&& entry : std::filesystem::directory_iterator(path, error))
+      {
+        if (entry.is_regular_file(error))
+          scripts.push_back(entry.path().string());
+      }
+      if (error)
+        throw std::string("Batch: failed to list ") + path + ": " + error.message();
+      std::sort(std::begin(scripts), std::end(scripts));
+      return scripts;
+    }
+
+    std::ifstream in(path.c_str());
+    if (!in.is_open())
+      throw std::string("Batch: failed to read ") + path;
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (line.length() && line.back() == '\r')
+        line.pop_back();
+      if (line.length())
+        scripts.push_back(line);
+    }
+    return scripts;
+  }
+
+  // runs every script, returning how many failed
+  uint64_t run(std::FILE* out = stdout, std::FILE* err = stderr)
+  {
+    results.assign(files.size(), Result());
+    loaded = 0;
+    written = 0;
+
+    ThreadPool pool(workers);
+    std::thread reader([this, &pool]() { read(pool); });
+
+    uint64_t failed = 0;
+    bool writing = true;
+    std::string buffer;
+    for (std::vector<Result>::size_type i = 0; i < results.size(); ++i)
+    {
+      Result result;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this, i]() { return results[i].done; });
+        std::swap(result, results[i]);
+        ++written;
+      }
+      room.notify_one();
+
+      header(buffer, files[i], result.error.empty());
+      buffer += result.output;
+      if (writing && std::fwrite(buffer.data(), 1, buffer.length(), out) != buffer.length())
+        writing = false; // let the rest finish before saying so
+      buffer.clear();
+      if (!result.error.empty())
+      {
+        ++failed;
+        std::fprintf(err, "%s: %s\n", files[i].c_str(), result.error.c_str());
+      }
+    }
+    reader.join();
+    std::fflush(out);
+    std::fflush(err);
+    if (!writing)
+      throw std::string("Batch: failed to write results");
+    return failed;
+  }
+
+private:
+  // how many scripts can be loaded but not yet written, per worker
+  static const uint64_t AHEAD = 4;
+
+  struct Result
+  {
+    Result() : done(false) {};
+
+    std::string output;
+    std::string error;
+    bool done;
+  };
+
+  // loads each script and hands it to the workers, staying only so far
+  // ahead of what's been written out
+  void read(ThreadPool& pool)
+  {
+    for (std::vector<std::string>::size_type i = 0; i < files.size(); ++i)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        room.wait(lock, [this]() { return loaded - written < AHEAD * workers; });
+        ++loaded;
+      }
+
+      std::string script;
+      if (!load(files[i], script))
+      {
+        Result result;
+        result.error = "failed to read script";
+        finish(i, std::move(result));
+        continue;
+      }
+      pool.submit([this, i, script = std::move(script)]() { evaluate(i, script); });
+    }
+  }
+
+  static bool load(const std::string& file, std::string& script)
+  {
+    std::ifstream in(file.c_str(), std::ios::binary);
+    if (!in.is_open())
+      return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    script = ss.str();
+    return !in.bad();
+  }
+
+  void evaluate(const std::vector<Result>::size_type i, const std::string& script)
+  {
+    // the worker's, reused for every script it runs
+    static thread_local Arena arena;
+    arena.reset();
+    Arena::Use use(&arena);
+
+    Result result;
+    try
+    {
+      Interpreter interpreter(new Parser(new Lexer(script, files[i]), 1, &arena), options, 1, tiering);
+      interpreter.setBudget(budget);
+      interpreter.setGlobalScope(globalScope);
+      interpreter.compile();
+      interpreter.run();
+      output.write(interpreter.getScope(), result.output);
+    }
+    catch (std::string e)
+    {
+      result.output.clear();
+      result.error = e;
+    }
+    catch (std::exception& e)
+    {
+      result.output.clear();
+      result.error = e.what();
+    }
+    finish(i, std::move(result));
+  }
+
+  void finish(const std::vector<Result>::size_type i, Result result)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      result.done = true;
+      results[i] = std::move(result);
+    }
+    done.notify_all();
+  }
+
+  void header(std::string& buffer, const std::string& file, const bool ok) const
+  {
+    if (output.getFormat() != Output::BINARY)
+    {
+      buffer += "==> ";
+      buffer += file;
+      buffer += " <==\n";
+      return;
+    }
+    const uint32_t length = static_cast<uint32_t>(file.length());
+    char bytes[sizeof(length)];
+    std::memcpy(bytes, &length, sizeof(length));
+    buffer.append(bytes, sizeof(length));
+    buffer += file;
+    buffer += static_cast<char>(ok ? 1 : 0);
+  }
+
+  std::vector<std::string> files;
+  Output output;
+  Optimizer::Options options;
+  Interpreter::Tiering tiering;
+  Budget budget;
+  bool globalScope;
+  uint32_t workers;
+
+  std::mutex mutex;
+  std::condition_variable done; // a script has finished
+  std::condition_variable room; // a result has been written
+  std::vector<Result> results;
+  uint64_t loaded;
+  uint64_t written;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef BUDGET_H_INCLUDE
+#define BUDGET_H_INCLUDE
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Limits on what a script may use, each 0 for no limit. Compiling and every
+// run each get the whole of them.
+struct Budget
+{
+  Budget() : fuel(0), memory(0), milliseconds(0), nesting(0) {};
+
+  // nodes evaluated in a run
+  uint64_t fuel;
+  // bytes of arena the tokens and tree may take
+  std::size_t memory;
+  // wall clock time
+  uint64_t milliseconds;
+  // how deeply statements and expressions may nest
+  uint32_t nesting;
+
+  // whether anything's checked while lexing and evaluating
+  inline bool metered() const { return fuel || milliseconds; };
+
+  // What's thrown when a limit is reached. It's a std::string saying which,
+  // so it's caught and reported like any other error unless it's caught as
+  // itself first.
+  class Exceeded : public std::string
+  {
+  public:
+    enum Limit
+    {
+      FUEL,
+      MEMORY,
+      TIME,
+      NESTING
+    };
+
+    Exceeded(const Limit l, const uint64_t m) : std::string(message(l, m)), limit(l), maximum(m) {};
+
+    inline Limit getLimit() const { return limit; };
+    // the limit that was reached
+    inline uint64_t getMaximum() const { return maximum; };
+
+    static std::string fromLimit(const Limit l)
+    {
+      switch (l)
+      {
+        case FUEL:
+          return "fuel";
+        case MEMORY:
+          return "memory";
+        case TIME:
+          return "time";
+        case NESTING:
+          return "nesting";
+      }
+      return "unknown";
+    }
+
+  private:
+    static std::string message(const Limit l, const uint64_t m)
+    {
+      switch (l)
+      {
+        case FUEL:
+          return "Budget: evaluated more than " + std::to_string(m) + " nodes";
+        case MEMORY:
+          return "Budget: needed more than " + std::to_string(m) + " bytes";
+        case TIME:
+          return "Budget: ran for more than " + std::to_string(m) + "ms";
+        case NESTING:
+          return "Budget: nested more than " + std::to_string(m) + " deep";
+      }
+      return "Budget: exceeded";
+    }
+
+    Limit limit;
+    uint64_t maximum;
+  };
+
+  // Counts what's been done against the fuel and deadline. Counting is an
+  // add and a compare; the clock is only read every SLICE or so.
+  class Meter
+  {
+  public:
+    Meter() : fuel(0), milliseconds(0), count(0), next(UINT64_MAX) {};
+
+    // starts counting afresh against a budget
+    void start(const Budget& b)
+    {
+      fuel = b.fuel;
+      milliseconds = b.milliseconds;
+      count = 0;
+      if (milliseconds)
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+      schedule();
+    }
+
+    // throws if n more would be more than the fuel, or it's past the deadline
+    inline void charge(const uint64_t n)
+    {
+      count += n;
+      if (count >= next)
+        check();
+    }
+
+    inline uint64_t getCount() const { return count; };
+
+  private:
+    static const uint64_t SLICE = 1 << 12;
+
+    void check()
+    {
+      if (fuel && count > fuel)
+        throw Exceeded(Exceeded::FUEL, fuel);
+      if (milliseconds && std::chrono::steady_clock::now() >= deadline)
+        throw Exceeded(Exceeded::TIME, milliseconds);
+      schedule();
+    }
+
+    // when to check next: a slice from now, or the tick that runs out of fuel
+    void schedule()
+    {
+      if (!fuel && !milliseconds)
+      {
+        next = UINT64_MAX;
+        return;
+      }
+      next = milliseconds ? count + SLICE : UINT64_MAX;
+      if (fuel && fuel < next - 1)
+        next = fuel + 1;
+    }
+
+    uint64_t fuel;
+    uint64_t milliseconds;
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t count;
+    uint64_t next;
+  };
+};
+
+#endif
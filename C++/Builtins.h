@@ -0,0 +1,107 @@
+#ifndef BUILTINS_H_INCLUDE
+#define BUILTINS_H_INCLUDE
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "Value.h"
+
+// The functions scripts can call. Calls are resolved to their Builtin when
+// parsed, so running one is a call through a function pointer.
+struct Builtin
+{
+  static const uint32_t MAX_ARITY = 2;
+
+  typedef Value (*Scalar)(const Value* args);
+
+  const char* name;
+  uint32_t arity;
+  Value::Kind kind; // what it always returns, NONE if that depends on the arguments
+  Scalar scalar;
+};
+
+class Builtins
+{
+public:
+  // the builtin called `name`, nullptr if there isn't one
+  static const Builtin* find(const char* name)
+  {
+    for (const Builtin& b : table())
+    {
+      if (std::strcmp(b.name, name) == 0)
+        return &b;
+    }
+    return nullptr;
+  }
+
+private:
+  template <double (*F)(double)>
+  static Value real(const Value* args)
+  {
+    return Value(F(args[0].toReal()));
+  }
+
+  // integers are already whole
+  template <double (*F)(double)>
+  static Value rounding(const Value* args)
+  {
+    return args[0].isInt() ? args[0] : Value(F(args[0].toReal()));
+  }
+
+  static Value abs(const Value* args)
+  {
+    const Value& v = args[0];
+    if (v.isInt() && v.toInt() != std::numeric_limits<int64_t>::min())
+      return Value(v.toInt() < 0 ? -v.toInt() : v.toInt());
+    return Value(std::fabs(v.toReal()));
+  }
+
+  static Value min(const Value* args)
+  {
+    if (args[0].isInt() && args[1].isInt())
+      return Value(args[1].toInt() < args[0].toInt() ? args[1].toInt() : args[0].toInt());
+    return Value(std::fmin(args[0].toReal(), args[1].toReal()));
+  }
+
+  static Value max(const Value* args)
+  {
+    if (args[0].isInt() && args[1].isInt())
+      return Value(args[1].toInt() > args[0].toInt() ? args[1].toInt() : args[0].toInt());
+    return Value(std::fmax(args[0].toReal(), args[1].toReal()));
+  }
+
+  // wrappers, as the <cmath> names are overloaded
+  static double sqrt(double x) { return std::sqrt(x); };
+  static double exp(double x) { return std::exp(x); };
+  static double log(double x) { return std::log(x); };
+  static double log10(double x) { return std::log10(x); };
+  static double sin(double x) { return std::sin(x); };
+  static double cos(double x) { return std::cos(x); };
+  static double tan(double x) { return std::tan(x); };
+  static double floor(double x) { return std::floor(x); };
+  static double ceil(double x) { return std::ceil(x); };
+
+  static const std::vector<Builtin>& table()
+  {
+    static const std::vector<Builtin> builtins = {
+      {"abs",   1, Value::NONE, &abs},
+      {"sqrt",  1, Value::REAL, &real<sqrt>},
+      {"exp",   1, Value::REAL, &real<exp>},
+      {"log",   1, Value::REAL, &real<log>},
+      {"log10", 1, Value::REAL, &real<log10>},
+      {"sin",   1, Value::REAL, &real<sin>},
+      {"cos",   1, Value::REAL, &real<cos>},
+      {"tan",   1, Value::REAL, &real<tan>},
+      {"floor", 1, Value::NONE, &rounding<floor>},
+      {"ceil",  1, Value::NONE, &rounding<ceil>},
+      {"min",   2, Value::NONE, &min},
+      {"max",   2, Value::NONE, &max}
+    };
+    return builtins;
+  }
+};
+
+#endif
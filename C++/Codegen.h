@@ -0,0 +1,412 @@
+#ifndef CODEGEN_H_INCLUDE
+#define CODEGEN_H_INCLUDE
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+#include "Scope.h"
+#include "Token.h"
+#include "Value.h"
+
+// Translates a resolved tree into C++ source for Native to compile. Every
+// variable becomes a local Value, loaded from the caller's array on entry and
+// stored back on the way out, even when an error stops the program. Every
+// operation is the same Value function the Interpreter calls, and operands
+// are evaluated into temporaries in the Interpreter's order, so results and
+// errors match it exactly.
+//
+// The top level statements are split into functions of CHUNK statements,
+// each with locals for just the variables it uses, as compilers slow down a
+// lot on huge functions. A block's own variables are locals of a C++ block,
+// made afresh each time it's entered, and aren't in the caller's array.
+//
+// The generated object exports:
+//   interpreter_native_count  the number of variables
+//   interpreter_native_names  their names, in the order of the array, empty
+//                             for the slots of blocks' variables
+//   interpreter_native_run    int (Value* variables, char* error, size_t size)
+//                             0 on success, -1 with a message on failure
+class Codegen
+{
+public:
+  static const std::vector<AST*>::size_type CHUNK = 64;
+
+  Codegen() : temporaries(0), depth(1) {};
+  ~Codegen() {};
+
+  std::string generate(AST* tree, const Scope& scope)
+  {
+    names.resize(scope.size());
+    for (auto&& it : scope.getNames())
+      names[it.second] = it.first;
+
+    std::vector<AST*> statements;
+    if (tree->getType() == AST::COMPOUND)
+      statements = static_cast<Compound*>(tree)->getChildren();
+    else
+      statements.push_back(tree);
+
+    std::stringstream chunks;
+    std::vector<AST*>::size_type count = 0;
+    for (std::vector<AST*>::size_type first = 0; first < statements.size(); first += CHUNK, ++count)
+    {
+      body.str(std::string());
+      used.clear();
+      for (std::vector<AST*>::size_type i = first; i < std::min(statements.size(), first + CHUNK); ++i)
+        statement(statements[i]);
+      chunk(chunks, count);
+    }
+
+    std::stringstream out;
+    out << "#include <cmath>\n#include <cstddef>\n#include <cstring>\n#include <string>\n\n";
+    out << "#include \"Builtins.h\"\n#include \"Value.h\"\n\n";
+    out << "static inline const Value& read(const Value& v, const char* name)\n{\n";
+    out << "  if (v.isNone())\n";
+    out << "    throw std::string(\"Interpreter: variable used before assignment: \") + name;\n";
+    out << "  return v;\n}\n\n";
+    for (auto&& it : builtins)
+      out << "static const Builtin* const " << it.second << " = Builtins::find(\"" << it.first << "\");\n";
+    out << "\n" << chunks.str();
+
+    out << "extern \"C\" const unsigned interpreter_native_count = " << names.size() << ";\n";
+    out << "extern \"C\" const char* const interpreter_native_names[] = {";
+    for (const std::string& name : names)
+      out << "\"" << name << "\", ";
+    out << "nullptr};\n\n";
+
+    out << "extern \"C\" int interpreter_native_run(Value* variables, char* error, size_t size)\n{\n";
+    out << "  try\n  {\n";
+    for (std::vector<AST*>::size_type i = 0; i < count; ++i)
+      out << "    chunk" << i << "(variables);\n";
+    out << "  }\n";
+    out << "  catch (const std::string& e)\n  {\n";
+    out << "    if (error && size)\n    {\n";
+    out << "      std::strncpy(error, e.c_str(), size - 1);\n";
+    out << "      error[size - 1] = '\\0';\n    }\n";
+    out << "    return -1;\n  }\n";
+    out << "  return 0;\n}\n";
+    return out.str();
+  }
+
+private:
+  // a function running the statements generated into body
+  void chunk(std::stringstream& out, const std::vector<AST*>::size_type n)
+  {
+    std::stringstream store;
+    for (const uint32_t slot : used)
+      store << "variables[" << slot << "] = v" << slot << ";\n";
+    std::string line;
+
+    out << "static void chunk" << n << "(Value* variables)\n{\n";
+    for (const uint32_t slot : used)
+      out << "  Value v" << slot << " = variables[" << slot << "];\n";
+    out << "  try\n  {\n" << body.str() << "  }\n";
+    out << "  catch (...)\n  {\n";
+    while (std::getline(store, line))
+      out << "    " << line << "\n";
+    out << "    throw;\n  }\n";
+    store.clear();
+    store.seekg(0);
+    while (std::getline(store, line))
+      out << "  " << line << "\n";
+    out << "}\n\n";
+  }
+
+  void statement(AST* node)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::NO_OP:
+      break;
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        if (c->getFrameSize())
+        {
+          open();
+          for (uint32_t slot = c->getFrame(); slot < c->getFrame() + c->getFrameSize(); ++slot)
+            line() << "Value v" << slot << ";\n";
+        }
+        for (AST* child : c->getChildren())
+          statement(child);
+        if (c->getFrameSize())
+          close();
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        open();
+        const std::string v = expr(a->getRight());
+        use(a->getSlot());
+        line() << "v" << a->getSlot() << " = " << v << ";\n";
+        close();
+      }
+      break;
+      case AST::Type::STEP:
+        statement(static_cast<Step*>(node)->getAssign());
+      break;
+      case AST::Type::WHILE:
+      case AST::Type::FOR:
+      {
+        Loop* l = static_cast<Loop*>(node);
+        For* f = node->getType() == AST::FOR ? static_cast<For*>(node) : nullptr;
+        open();
+        if (f)
+          statement(f->getInit());
+        line() << "for (;;)\n";
+        open();
+        const std::string c = expr(l->getCondition());
+        line() << "if (!" << c << ".isTrue())\n";
+        line() << "  break;\n";
+        statement(l->getBody());
+        if (f)
+          statement(f->getStep());
+        close();
+        close();
+      }
+      break;
+      default:
+        throw std::string("Codegen: not a statement: ") + AST::fromType(node->getType());
+    }
+  }
+
+  // emits the evaluation of an expression, giving the temporary it's in
+  std::string expr(AST* node)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::NUMBER:
+        return define(number(static_cast<Number*>(node)->getValue()));
+      case AST::Type::VARIABLE:
+        return define(variable(static_cast<Variable*>(node)));
+      case AST::Type::OP_UNARY:
+      {
+        UnaryOp* u = static_cast<UnaryOp*>(node);
+        const std::string v = expr(u->getNode());
+        if (u->tokenType() == Token::SUBTRACTION)
+          return define("Value::negate(" + v + ")");
+        if (u->tokenType() == Token::BITWISE_NOT)
+          return define("Value(Value::bitwiseNot(" + v + ".toInt()))");
+        return v;
+      }
+      case AST::Type::OP_BINARY:
+      {
+        BinaryOp* b = static_cast<BinaryOp*>(node);
+        const std::string l = expr(b->getLeft());
+        const std::string r = expr(b->getRight());
+        return define(apply(b->tokenType(), l, r));
+      }
+      case AST::Type::OP_POWER:
+        return power(static_cast<PowerOp*>(node));
+      case AST::Type::OP_VAR_CONST:
+      {
+        VarConstOp* v = static_cast<VarConstOp*>(node);
+        const std::string x = define(variable(v->getVariable()));
+        const std::string c = define(number(v->getConstant()));
+        return define(v->isReversed() ? apply(v->tokenType(), c, x) : apply(v->tokenType(), x, c));
+      }
+      case AST::Type::OP_VAR_VAR:
+      {
+        VarVarOp* v = static_cast<VarVarOp*>(node);
+        const std::string l = define(variable(v->getLeft()));
+        const std::string r = define(variable(v->getRight()));
+        return define(apply(v->tokenType(), l, r));
+      }
+      case AST::Type::OP_MUL_ADD:
+      {
+        MulAddOp* m = static_cast<MulAddOp*>(node);
+        const std::string a = expr(m->getMultiplier());
+        const std::string b = expr(m->getMultiplicand());
+        const std::string c = expr(m->getAddend());
+        const std::string plain = "Value::add(Value::multiply(" + a + ", " + b + "), " + c + ")";
+        if (!m->isFused())
+          return define(plain);
+        body << "#ifdef FP_FAST_FMA\n";
+        const std::string t = define("!(" + a + ".isInt() && " + b + ".isInt()) ? Value(std::fma(" +
+                                     a + ".toReal(), " + b + ".toReal(), " + c + ".toReal())) : " + plain);
+        body << "#else\n";
+        line() << "const Value " << t << " = " << plain << ";\n";
+        body << "#endif\n";
+        return t;
+      }
+      case AST::Type::CALL:
+      {
+        Call* c = static_cast<Call*>(node);
+        std::vector<std::string> args;
+        for (AST* a : c->getArgs())
+          args.push_back(expr(a));
+        const std::string name = c->getBuiltin()->name;
+        if (!builtins.count(name))
+          builtins.emplace(name, "b_" + name);
+        const std::string array = temporary();
+        line() << "const Value " << array << "[" << Builtin::MAX_ARITY << "] = {";
+        for (const std::string& a : args)
+          body << a << ", ";
+        body << "};\n";
+        return define(builtins[name] + "->scalar(" + array + ")");
+      }
+      case AST::Type::HOISTED:
+        return expr(static_cast<Hoisted*>(node)->getNode()); // the compiler hoists it
+      case AST::Type::INDUCTION:
+      {
+        Induction* i = static_cast<Induction*>(node);
+        std::string l = define(variable(i->getVariable()));
+        std::string r = expr(i->getFactor());
+        if (i->isReversed())
+          return define("Value::multiply(" + r + ", " + l + ")");
+        return define("Value::multiply(" + l + ", " + r + ")");
+      }
+      default:
+        throw std::string("Codegen: not an expression: ") + AST::fromType(node->getType());
+    }
+  }
+
+  // the same as Interpreter::apply
+  static std::string apply(const Token::Type op, const std::string& l, const std::string& r)
+  {
+    const std::string both = "(" + l + ", " + r + ")";
+    const std::string ints = "(" + l + ".toInt(), " + r + ".toInt()))";
+    switch (op)
+    {
+      case Token::Type::ADDITION:
+        return "Value::add" + both;
+      case Token::Type::SUBTRACTION:
+        return "Value::subtract" + both;
+      case Token::Type::MULTIPLICATION:
+        return "Value::multiply" + both;
+      case Token::Type::DIVISION:
+        return "Value::divide" + both;
+      case Token::Type::POWER:
+        return "Value::power" + both;
+      case Token::Type::MODULO:
+        return "Value(Value::modulo" + ints;
+      case Token::Type::BITWISE_AND:
+        return "Value(Value::bitwiseAnd" + ints;
+      case Token::Type::BITWISE_OR:
+        return "Value(Value::bitwiseOr" + ints;
+      case Token::Type::BITWISE_XOR:
+        return "Value(Value::bitwiseXor" + ints;
+      case Token::Type::BITSHIFT_L:
+        return "Value(Value::shiftLeft" + ints;
+      case Token::Type::BITSHIFT_R:
+        return "Value(Value::shiftRight" + ints;
+      case Token::Type::LESS:
+        return "Value(static_cast<int64_t>(Value::less" + both + "))";
+      case Token::Type::GREATER:
+        return "Value(static_cast<int64_t>(Value::less(" + r + ", " + l + ")))";
+      case Token::Type::LESS_EQUAL:
+        return "Value(static_cast<int64_t>(Value::lessEqual" + both + "))";
+      case Token::Type::GREATER_EQUAL:
+        return "Value(static_cast<int64_t>(Value::lessEqual(" + r + ", " + l + ")))";
+      case Token::Type::EQUAL:
+        return "Value(static_cast<int64_t>(Value::equal" + both + "))";
+      case Token::Type::NOT_EQUAL:
+        return "Value(static_cast<int64_t>(!Value::equal" + both + "))";
+      default:
+        throw std::string("Codegen: bad binary op ") + Token::fromType(op);
+    }
+  }
+
+  // the same as Interpreter::visitPowerOp
+  std::string power(PowerOp* node)
+  {
+    const std::string b = expr(node->getBase());
+    switch (node->getKernel())
+    {
+      case PowerOp::ZERO:
+        return define(b + ".isInt() ? Value(static_cast<int64_t>(1)) : Value(1.0)");
+      case PowerOp::ONE:
+        return b;
+      case PowerOp::SQUARE:
+        return define("Value::square(" + b + ")");
+      case PowerOp::RECIPROCAL:
+        return define("Value::reciprocal(" + b + ")");
+      case PowerOp::SQRT:
+        return define("Value::squareRoot(" + b + ")");
+      case PowerOp::INTEGER:
+        return define("Value::powerConstant(" + b + ", INT64_C(" + std::to_string(node->getExponent()) + "), true)");
+      case PowerOp::SQUARING:
+        return define("Value::powerConstant(" + b + ", INT64_C(" + std::to_string(node->getExponent()) + "), false)");
+    }
+    return b; // not going to happen
+  }
+
+  std::string variable(Variable* node)
+  {
+    use(node->getSlot());
+    return "read(v" + std::to_string(node->getSlot()) + ", \"" + node->getName() + "\")";
+  }
+
+  // notes a global the chunk has to load and store
+  inline void use(const uint32_t slot)
+  {
+    if (names[slot].length())
+      used.insert(slot);
+  }
+
+  // a literal for exactly this value
+  static std::string number(const Value& v)
+  {
+    if (v.isInt())
+    {
+      if (v.toInt() == std::numeric_limits<int64_t>::min())
+        return "Value(std::numeric_limits<int64_t>::min())";
+      return "Value(static_cast<int64_t>(INT64_C(" + std::to_string(v.toInt()) + ")))";
+    }
+    const double d = v.toReal();
+    if (std::isnan(d))
+      return "Value(std::numeric_limits<double>::quiet_NaN())";
+    if (std::isinf(d))
+      return d < 0 ? "Value(-std::numeric_limits<double>::infinity())" : "Value(std::numeric_limits<double>::infinity())";
+    char digits[64];
+    std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), std::fabs(d), std::chars_format::hex);
+    return std::string("Value(") + (std::signbit(d) ? "-" : "") + "0x" + std::string(digits, r.ptr) + ")";
+  }
+
+  // a new temporary holding the value of `code`
+  std::string define(const std::string& code)
+  {
+    const std::string t = temporary();
+    line() << "const Value " << t << " = " << code << ";\n";
+    return t;
+  }
+
+  inline std::string temporary() { return "t" + std::to_string(temporaries++); };
+
+  // statements get their own C++ block, so temporaries don't pile up
+  void open()
+  {
+    line() << "{\n";
+    ++depth;
+  }
+  void close()
+  {
+    --depth;
+    line() << "}\n";
+  }
+
+  std::stringstream& line()
+  {
+    for (uint32_t i = 0; i < depth + 1; ++i)
+      body << "  ";
+    return body;
+  }
+
+  std::vector<std::string> names;
+  std::map<std::string, std::string> builtins;
+  std::stringstream body; // of the current chunk
+  std::set<uint32_t> used; // by the current chunk
+  uint64_t temporaries;
+  uint32_t depth;
+};
+
+#endif
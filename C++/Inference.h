@@ -0,0 +1,207 @@
+#ifndef INFERENCE_H_INCLUDE
+#define INFERENCE_H_INCLUDE
+
+#include <cstdint>
+#include <map>
+
+#include "AST.h"
+#include "Token.h"
+#include "Value.h"
+
+// Annotates every node with the kind of value it is guaranteed to produce.
+// Outside of loops programs are straight-line, so tracking the kind of the
+// last assignment to each variable is exact. Variables are told apart by
+// slot, so the tree has to have been resolved, and a block's variables are
+// forgotten whenever it's entered. A loop body is inferred until
+// the kinds at the top of the loop stop changing, a variable assigned
+// different kinds on different iterations being NONE.
+// INT results are literals, the operators that cast to int64_t, and +, -
+// and * of INT operands. Those three promote to REAL on overflow, which the
+// interpreter's integer path checks for, falling back to Values, so a
+// variable inferred INT may still hold a REAL after one.
+class Inference
+{
+public:
+  Inference() : integers(0) {};
+  ~Inference() {};
+
+  Value::Kind infer(AST* node)
+  {
+    Value::Kind k = Value::NONE;
+    switch (node->getType())
+    {
+      case AST::Type::NO_OP:
+      break;
+      case AST::Type::OP_UNARY:
+        k = inferUnaryOp(static_cast<UnaryOp*>(node));
+        count(node, k);
+      break;
+      case AST::Type::OP_BINARY:
+        k = inferBinaryOp(static_cast<BinaryOp*>(node));
+        count(node, k);
+      break;
+      case AST::Type::NUMBER:
+        k = static_cast<Number*>(node)->getValue().getKind();
+      break;
+      case AST::Type::VARIABLE:
+      {
+        auto it = scope.find(static_cast<Variable*>(node)->getSlot());
+        if (it != std::end(scope))
+          k = it->second;
+      }
+      break;
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        for (uint32_t slot = c->getFrame(); slot < c->getFrame() + c->getFrameSize(); ++slot)
+          scope.erase(slot);
+        for (AST* child : c->getChildren())
+          infer(child);
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        scope[a->getSlot()] = infer(a->getRight());
+      }
+      break;
+      case AST::Type::OP_POWER:
+      {
+        PowerOp* p = static_cast<PowerOp*>(node);
+        k = powerKind(p->getKernel(), infer(p->getBase()));
+      }
+      break;
+      case AST::Type::CALL:
+      {
+        Call* c = static_cast<Call*>(node);
+        for (AST* a : c->getArgs())
+          infer(a);
+        k = c->getBuiltin()->kind;
+      }
+      break;
+      case AST::Type::WHILE:
+        inferLoop(static_cast<Loop*>(node), nullptr);
+      break;
+      case AST::Type::FOR:
+        infer(static_cast<For*>(node)->getInit());
+        inferLoop(static_cast<Loop*>(node), static_cast<For*>(node)->getStep());
+      break;
+      case AST::Type::OP_VAR_CONST:
+      case AST::Type::OP_VAR_VAR:
+      case AST::Type::OP_MUL_ADD:
+      case AST::Type::HOISTED:
+      case AST::Type::INDUCTION:
+      case AST::Type::STEP:
+        return node->getKind(); // only built after inference
+    }
+    node->setKind(k);
+    return k;
+  }
+
+  // how many operators are INT, evaluated on the integer path
+  inline uint64_t getIntegers() const { return integers; };
+
+  static Value::Kind powerKind(const PowerOp::Kernel kernel, const Value::Kind base)
+  {
+    if (kernel == PowerOp::RECIPROCAL || kernel == PowerOp::SQRT || base == Value::REAL)
+      return Value::REAL;
+    return Value::NONE;
+  }
+
+private:
+  // loop bodies are inferred more than once, so counts the change
+  void count(AST* node, const Value::Kind k)
+  {
+    if (k == Value::INT && node->getKind() != Value::INT)
+      ++integers;
+    else if (k != Value::INT && node->getKind() == Value::INT)
+      --integers;
+  }
+
+  void inferLoop(Loop* node, AST* step)
+  {
+    // the kinds at the top of the loop, which is also where it's left
+    std::map<uint32_t, Value::Kind> top = scope;
+    while (true)
+    {
+      scope = top;
+      infer(node->getCondition());
+      infer(node->getBody());
+      if (step)
+        infer(step);
+
+      bool changed = false;
+      for (auto&& it : scope)
+      {
+        auto t = top.find(it.first);
+        if (t == std::end(top))
+          top.emplace(it.first, it.second);
+        else if (t->second == it.second || t->second == Value::NONE)
+          continue;
+        else
+          t->second = Value::NONE;
+        changed = true;
+      }
+      if (!changed)
+        break;
+    }
+    scope = top;
+  }
+
+  Value::Kind inferUnaryOp(UnaryOp* node)
+  {
+    Value::Kind k = infer(node->getNode());
+    switch (node->tokenType())
+    {
+      case Token::Type::ADDITION:
+        return k;
+      case Token::Type::SUBTRACTION:
+        return k == Value::REAL ? Value::REAL : Value::NONE;
+      case Token::Type::BITWISE_NOT:
+        return Value::INT;
+      default:
+        return Value::NONE;
+    }
+  }
+
+  Value::Kind inferBinaryOp(BinaryOp* node)
+  {
+    Value::Kind l = infer(node->getLeft());
+    Value::Kind r = infer(node->getRight());
+    switch (node->tokenType())
+    {
+      case Token::Type::ADDITION:
+      case Token::Type::SUBTRACTION:
+      case Token::Type::MULTIPLICATION:
+        if (l == Value::REAL || r == Value::REAL)
+          return Value::REAL;
+        return l == Value::INT && r == Value::INT ? Value::INT : Value::NONE;
+      case Token::Type::DIVISION:
+        if (l == Value::REAL || r == Value::REAL)
+          return Value::REAL;
+        return Value::NONE;
+      case Token::Type::POWER:
+        return l == Value::REAL || r == Value::REAL ? Value::REAL : Value::NONE;
+      case Token::Type::MODULO:
+      case Token::Type::BITWISE_AND:
+      case Token::Type::BITWISE_OR:
+      case Token::Type::BITWISE_XOR:
+      case Token::Type::BITSHIFT_L:
+      case Token::Type::BITSHIFT_R:
+      case Token::Type::LESS:
+      case Token::Type::GREATER:
+      case Token::Type::LESS_EQUAL:
+      case Token::Type::GREATER_EQUAL:
+      case Token::Type::EQUAL:
+      case Token::Type::NOT_EQUAL:
+        return Value::INT;
+      default:
+        return Value::NONE;
+    }
+  }
+
+  std::map<uint32_t, Value::Kind> scope; // by slot
+  uint64_t integers;
+};
+
+#endif
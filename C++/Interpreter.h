@@ -2,22 +2,84 @@
 #define INTERPRETER_H_INCLUDE
 
 #include <cctype> // std::isalpha, std::isalnum, std::isdigit, etc
+#include <iostream>
 #include <string>
+#include <atomic>
 #include <cmath>
 #include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "Budget.h"
+#include "Codegen.h"
+#include "Inference.h"
+#include "Native.h"
+#include "Optimizer.h"
+#include "Output.h"
 #include "Parser.h"
+#include "Published.h"
+#include "Schedule.h"
+#include "Scope.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
 #include "Token.h"
+#include "Value.h"
 
+// Programs start out running the tree as parsed, which costs nothing to
+// set up. Once one is hot, run often enough or with a loop iterating enough,
+// a copy of it is optimized in the background. The copy replaces the
+// original when it's next run, and hot loops switch over to their copy
+// between iterations. Both trees work on the same Scope, so nothing has to
+// be carried across.
 class Interpreter
 {
 public:
-  Interpreter(Parser* p) : parser(p), tree(nullptr) {};
-  ~Interpreter() { if (tree) delete tree; delete parser; };
+  // when to optimize
+  struct Tiering
+  {
+    Tiering() : enabled(true), runs(2), iterations(10000) {};
+
+    // false to optimize when compiling, which is what happens without
+    // strictFP whatever this says
+    bool enabled;
+    // once the program has been run this many times
+    uint64_t runs;
+    // once a loop has iterated this many times in all
+    uint64_t iterations;
+  };
+
+  // threads: how many threads run independent statements, 1 to run
+  // everything in order, 0 for one per core
+  Interpreter(Parser* p, const Optimizer::Options& o = Optimizer::Options(), const uint32_t threads = 1, const Tiering& t = Tiering()) : parser(p), tree(nullptr), options(o), global(false), integers(0), metered(false), tiering(t), runs(0), requested(false), optimized(nullptr), owner(std::this_thread::get_id())
+  {
+    if (threads != 1)
+      pool.reset(new ThreadPool(ThreadPool::threads(threads)));
+    // An optimized tree only gives the same results as the parsed one with
+    // strictFP, so anything else would depend on when the background
+    // optimizing happened to finish.
+    if (!options.strictFP)
+      tiering.enabled = false;
+  };
+  // runs the script of a snapshot, starting from its variables
+  Interpreter(const Snapshot& s, const Optimizer::Options& o = Optimizer::Options(), const uint32_t threads = 1, const Tiering& t = Tiering())
+    : Interpreter(new Parser(new Lexer(programOf(s), s.getFile())), o, threads, t)
+  {
+    restore(s);
+  };
+  ~Interpreter()
+  {
+    compiler.reset(); // finishes any optimizing
+    delete optimized.load();
+    if (tree)
+      delete tree;
+    delete parser;
+  };
 
   inline void error(const std::string& msg) { throw std::string("Interpreter: ") + msg; };
 
-  double visit(AST* node)
+  Value visit(AST* node)
   {
     switch (node->getType())
     {
@@ -38,10 +100,116 @@ public:
       case AST::Type::ASSIGN:
         visitAssign(static_cast<Assign*>(node));
       break;
+      case AST::Type::OP_POWER:
+        return visitPowerOp(static_cast<PowerOp*>(node));
+      case AST::Type::OP_VAR_CONST:
+        return visitVarConstOp(static_cast<VarConstOp*>(node));
+      case AST::Type::OP_VAR_VAR:
+        return visitVarVarOp(static_cast<VarVarOp*>(node));
+      case AST::Type::OP_MUL_ADD:
+        return visitMulAddOp(static_cast<MulAddOp*>(node));
+      case AST::Type::CALL:
+        return visitCall(static_cast<Call*>(node));
+      case AST::Type::WHILE:
+        visitWhile(static_cast<While*>(node));
+      break;
+      case AST::Type::FOR:
+        visitFor(static_cast<For*>(node));
+      break;
+      case AST::Type::HOISTED:
+        return visitHoisted(static_cast<Hoisted*>(node));
+      case AST::Type::INDUCTION:
+        return visitInduction(static_cast<Induction*>(node));
+      case AST::Type::STEP:
+        visitStep(static_cast<Step*>(node));
+      break;
       default:
         error(std::string("Unknown visit: ") + AST::fromType(node->getType()));
     }
-    return 0.0; // may happen, but if it does we don't care
+    return Value(); // may happen, but if it does we don't care
+  }
+
+  // evaluates a subtree for its int64_t value, staying out of Value entirely
+  // for the parts that were inferred to be INT
+  int64_t visitInteger(AST* node)
+  {
+    try
+    {
+      return integer(node);
+    }
+    catch (Overflow)
+    {
+      return visit(node).toInt();
+    }
+  }
+
+  int64_t integer(AST* node)
+  {
+    if (node->getKind() != Value::INT)
+      return visit(node).toInt();
+
+    switch (node->getType())
+    {
+      case AST::Type::NUMBER:
+        return static_cast<Number*>(node)->getValue().toInt();
+      case AST::Type::OP_UNARY:
+      {
+        UnaryOp* u = static_cast<UnaryOp*>(node);
+        if (u->tokenType() == Token::BITWISE_NOT)
+          return Value::bitwiseNot(integer(u->getNode()));
+        return integer(u->getNode()); // unary + is the only other INT
+      }
+      case AST::Type::OP_BINARY:
+        return integerOp(static_cast<BinaryOp*>(node));
+      default:
+      {
+        const Value v = visit(node);
+        if (!v.isInt())
+          throw Overflow();
+        return v.toInt();
+      }
+    }
+  }
+
+  int64_t integerOp(BinaryOp* node)
+  {
+    // comparisons are INT whatever they compare
+    if (node->tokenType() & COMPARISONS)
+      return compare(node->tokenType(), visit(node->getLeft()), visit(node->getRight()));
+
+    int64_t l = integer(node->getLeft());
+    int64_t r = integer(node->getRight());
+    int64_t res;
+    switch (node->tokenType())
+    {
+      case Token::Type::ADDITION:
+        if (__builtin_add_overflow(l, r, &res))
+          throw Overflow();
+        return res;
+      case Token::Type::SUBTRACTION:
+        if (__builtin_sub_overflow(l, r, &res))
+          throw Overflow();
+        return res;
+      case Token::Type::MULTIPLICATION:
+        if (__builtin_mul_overflow(l, r, &res))
+          throw Overflow();
+        return res;
+      case Token::Type::MODULO:
+        return Value::modulo(l, r);
+      case Token::Type::BITWISE_AND:
+        return Value::bitwiseAnd(l, r);
+      case Token::Type::BITWISE_OR:
+        return Value::bitwiseOr(l, r);
+      case Token::Type::BITWISE_XOR:
+        return Value::bitwiseXor(l, r);
+      case Token::Type::BITSHIFT_L:
+        return Value::shiftLeft(l, r);
+      case Token::Type::BITSHIFT_R:
+        return Value::shiftRight(l, r);
+      default:
+        error("bad integer op visit");
+    }
+    return 0; // not going to happen
   }
 
   void visitNoOp(/*NoOp* node*/)
@@ -49,87 +217,698 @@ public:
     return;
   }
 
-  double visitUnaryOp(UnaryOp* node)
+  Value visitUnaryOp(UnaryOp* node)
   {
     if (node->tokenType() == Token::ADDITION)
       return visit(node->getNode());
     else if (node->tokenType() == Token::SUBTRACTION)
-      return -visit(node->getNode());
+      return Value::negate(visit(node->getNode()));
     else if (node->tokenType() == Token::BITWISE_NOT)
-      return ~static_cast<int64_t>(visit(node->getNode()));
+      return Value(Value::bitwiseNot(visitInteger(node->getNode())));
     error("bad unary op visit");
-    return 0.0; // not going to happen
+    return Value(); // not going to happen
   }
 
-  double visitBinaryOp(BinaryOp* node)
+  Value visitBinaryOp(BinaryOp* node)
   {
-    switch (node->tokenType())
+    if (node->getKind() == Value::INT)
+    {
+      try
+      {
+        return Value(integerOp(node));
+      }
+      catch (Overflow)
+      {
+        // worked out with Values instead
+      }
+    }
+    const Value l = visit(node->getLeft());
+    const Value r = visit(node->getRight());
+    return apply(node->tokenType(), l, r);
+  }
+
+  Value apply(const Token::Type op, const Value& l, const Value& r)
+  {
+    switch (op)
     {
       case Token::Type::ADDITION:
-        return visit(node->getLeft()) + visit(node->getRight());
+        return Value::add(l, r);
       case Token::Type::SUBTRACTION:
-        return visit(node->getLeft()) - visit(node->getRight());
+        return Value::subtract(l, r);
       case Token::Type::MULTIPLICATION:
-        return visit(node->getLeft()) * visit(node->getRight());
+        return Value::multiply(l, r);
       case Token::Type::DIVISION:
-        return visit(node->getLeft()) / visit(node->getRight());
-      case Token::Type::MODULO:
-        return static_cast<int64_t>(visit(node->getLeft())) % static_cast<int64_t>(visit(node->getRight()));
+        return Value::divide(l, r);
       case Token::Type::POWER:
-        return std::pow(visit(node->getLeft()), visit(node->getRight()));
+        return Value::power(l, r);
+      case Token::Type::MODULO:
+        return Value(Value::modulo(l.toInt(), r.toInt()));
       case Token::Type::BITWISE_AND:
-        return static_cast<int64_t>(visit(node->getLeft())) & static_cast<int64_t>(visit(node->getRight()));
+        return Value(Value::bitwiseAnd(l.toInt(), r.toInt()));
       case Token::Type::BITWISE_OR:
-        return static_cast<int64_t>(visit(node->getLeft())) | static_cast<int64_t>(visit(node->getRight()));
+        return Value(Value::bitwiseOr(l.toInt(), r.toInt()));
       case Token::Type::BITWISE_XOR:
-        return static_cast<int64_t>(visit(node->getLeft())) ^ static_cast<int64_t>(visit(node->getRight()));
+        return Value(Value::bitwiseXor(l.toInt(), r.toInt()));
       case Token::Type::BITSHIFT_L:
-        return static_cast<int64_t>(visit(node->getLeft())) << static_cast<int64_t>(visit(node->getRight()));
+        return Value(Value::shiftLeft(l.toInt(), r.toInt()));
       case Token::Type::BITSHIFT_R:
-        return static_cast<int64_t>(visit(node->getLeft())) >> static_cast<int64_t>(visit(node->getRight()));
+        return Value(Value::shiftRight(l.toInt(), r.toInt()));
+      case Token::Type::LESS:
+      case Token::Type::GREATER:
+      case Token::Type::LESS_EQUAL:
+      case Token::Type::GREATER_EQUAL:
+      case Token::Type::EQUAL:
+      case Token::Type::NOT_EQUAL:
+        return Value(compare(op, l, r));
       default:
         error("bad binary op visit");
     }
-    return 0.0; // not going to happen
+    return Value(); // not going to happen
   }
 
-  double visitNumber(Number* node)
+  // 1 if the comparison holds, 0 if not
+  int64_t compare(const Token::Type op, const Value& l, const Value& r)
+  {
+    switch (op)
+    {
+      case Token::Type::LESS:
+        return Value::less(l, r);
+      case Token::Type::GREATER:
+        return Value::less(r, l);
+      case Token::Type::LESS_EQUAL:
+        return Value::lessEqual(l, r);
+      case Token::Type::GREATER_EQUAL:
+        return Value::lessEqual(r, l);
+      case Token::Type::EQUAL:
+        return Value::equal(l, r);
+      case Token::Type::NOT_EQUAL:
+        return !Value::equal(l, r);
+      default:
+        error("bad comparison visit");
+    }
+    return 0; // not going to happen
+  }
+
+  Value visitVarConstOp(VarConstOp* node)
+  {
+    const Value v = visitVariable(node->getVariable());
+    if (node->isReversed())
+      return apply(node->tokenType(), node->getConstant(), v);
+    return apply(node->tokenType(), v, node->getConstant());
+  }
+
+  Value visitVarVarOp(VarVarOp* node)
+  {
+    const Value l = visitVariable(node->getLeft());
+    const Value r = visitVariable(node->getRight());
+    return apply(node->tokenType(), l, r);
+  }
+
+  Value visitMulAddOp(MulAddOp* node)
+  {
+    const Value a = visit(node->getMultiplier());
+    const Value b = visit(node->getMultiplicand());
+    const Value c = visit(node->getAddend());
+#ifdef FP_FAST_FMA
+    // only worth it (and only allowed) when the product is a double
+    if (node->isFused() && !(a.isInt() && b.isInt()))
+      return Value(std::fma(a.toReal(), b.toReal(), c.toReal()));
+#endif
+    return Value::add(Value::multiply(a, b), c);
+  }
+
+  Value visitPowerOp(PowerOp* node)
+  {
+    const Value base = visit(node->getBase());
+    switch (node->getKernel())
+    {
+      case PowerOp::ZERO:
+        return base.isInt() ? Value(static_cast<int64_t>(1)) : Value(1.0);
+      case PowerOp::ONE:
+        return base;
+      case PowerOp::SQUARE:
+        return Value::square(base);
+      case PowerOp::RECIPROCAL:
+        return Value::reciprocal(base);
+      case PowerOp::SQRT:
+        return Value::squareRoot(base);
+      case PowerOp::INTEGER:
+        return Value::powerConstant(base, node->getExponent(), true);
+      case PowerOp::SQUARING:
+        return Value::powerConstant(base, node->getExponent(), false);
+    }
+    return Value(); // not going to happen
+  }
+
+  Value visitCall(Call* node)
+  {
+    Value args[Builtin::MAX_ARITY];
+    const std::vector<AST*>& a = node->getArgs();
+    for (std::vector<AST*>::size_type i = 0; i < a.size(); ++i)
+      args[i] = visit(a[i]);
+    return node->getBuiltin()->scalar(args);
+  }
+
+  Value visitNumber(Number* node)
   {
     return node->getValue();
   }
 
-  double visitVariable(Variable* node)
+  Value visitVariable(Variable* node)
   {
-    auto it = GLOBAL_SCOPE.find(node->getName());
-    if (it == std::end(GLOBAL_SCOPE))
+    const Value v = GLOBAL_SCOPE.get(node->getSlot());
+    if (v.isNone())
       error(std::string("variable used before assignment: ") + node->getName());
-    return it->second;
+    return v;
   }
 
   void visitCompound(Compound* node)
   {
+    if (node->getFrameSize())
+      GLOBAL_SCOPE.clear(node->getFrame(), node->getFrameSize());
+    // metering counts on one thread
+    if (pool && !metered && std::this_thread::get_id() == owner && visitCompoundParallel(node))
+      return;
     for (AST* child : node->getChildren())
       visit(child);
   }
 
+  // Runs the statements of a compound level by level, spreading each level
+  // over the pool. Only the thread that owns the pool schedules, the
+  // workers run what they're given in order. False if the compound has to
+  // run in order after all. If a statement fails, the variables are left as
+  // running in order would have left them: whatever ran after it is undone
+  // and whatever should have run before it is run, before rethrowing.
+  bool visitCompoundParallel(Compound* node)
+  {
+    std::unique_ptr<Schedule>& schedule = schedules[node];
+    if (!schedule)
+      schedule.reset(new Schedule(node));
+    if (!schedule->isParallel())
+      return false;
+
+    // anything read before it's assigned has to exist already, or running in
+    // order is the only way to fail at the right statement
+    for (const uint32_t slot : schedule->getInputs())
+    {
+      if (GLOBAL_SCOPE.get(slot).isNone())
+        return false;
+    }
+
+    typedef std::vector<AST*>::size_type Index;
+    const std::vector<AST*>& children = node->getChildren();
+    const std::vector<std::vector<Index>>& levels = schedule->getLevels();
+    const std::vector<uint32_t>& writes = schedule->getWrites();
+    const std::vector<std::vector<uint32_t>::size_type>& first = schedule->getFirst();
+    std::vector<Value> before(writes.size()); // what each statement overwrote
+    std::vector<bool> ran(children.size());
+
+    for (std::vector<std::vector<Index>>::size_type l = 0; l < levels.size(); ++l)
+    {
+      const std::vector<Index>& level = levels[l];
+      for (const Index i : level)
+      {
+        for (auto w = first[i]; w < first[i + 1]; ++w)
+          before[w] = GLOBAL_SCOPE.get(writes[w]);
+        ran[i] = true;
+      }
+
+      // the first error of each chunk, as (statement, message)
+      const Index chunks = std::min<Index>(pool->size(), level.size());
+      std::vector<std::pair<Index, std::string>> errors(chunks);
+      if (chunks == 1)
+      {
+        for (const Index i : level)
+        {
+          try
+          {
+            visit(children[i]);
+          }
+          catch (std::string e)
+          {
+            errors[0] = std::make_pair(i, e);
+            break;
+          }
+        }
+      }
+      else
+      {
+        for (Index c = 0; c < chunks; ++c)
+        {
+          const Index from = level.size() * c / chunks;
+          const Index to = level.size() * (c + 1) / chunks;
+          pool->submit([this, &children, &level, &errors, c, from, to]() {
+            for (Index i = from; i < to; ++i)
+            {
+              try
+              {
+                visit(children[level[i]]);
+              }
+              catch (std::string e)
+              {
+                errors[c] = std::make_pair(level[i], e);
+                return;
+              }
+            }
+          });
+        }
+        pool->wait();
+      }
+
+      const std::pair<Index, std::string>* failed = nullptr;
+      for (const std::pair<Index, std::string>& e : errors)
+      {
+        if (e.second.length() && (!failed || e.first < failed->first))
+          failed = &e;
+      }
+      if (!failed)
+        continue;
+
+      // nothing at or before the failure depends on what ran after it, so
+      // undoing that, latest first, and then running what was skipped, in
+      // order, is the same as having run in order
+      for (auto it = levels.rbegin() + (levels.size() - 1 - l); it != levels.rend(); ++it)
+      {
+        for (auto i = it->rbegin(); i != it->rend(); ++i)
+        {
+          if (*i <= failed->first)
+            continue;
+          for (auto w = first[*i]; w < first[*i + 1]; ++w)
+            restore(writes[w], before[w]);
+        }
+      }
+      for (Index i = 0; i < failed->first; ++i)
+      {
+        if (!ran[i])
+          visit(children[i]);
+      }
+      throw failed->second;
+    }
+    return true;
+  }
+
+  // puts a variable back to what it was
+  void restore(const uint32_t slot, const Value& v)
+  {
+    GLOBAL_SCOPE.set(slot, v);
+    if (published && slot < published->size())
+      published->set(slot, v);
+  }
+
   void visitAssign(Assign* node)
   {
-    GLOBAL_SCOPE[node->getName()] = visit(node->getRight());
+    if (metered)
+      meter.charge(node->getCost());
+    GLOBAL_SCOPE.set(node->getSlot(), visit(node->getRight()));
+    if (published)
+      published->set(node->getSlot(), GLOBAL_SCOPE.get(node->getSlot()));
+  }
+
+  void visitWhile(While* node)
+  {
+    enter(node);
+    while (test(node))
+    {
+      visit(node->getBody());
+      if (Loop* o = promoted(node))
+        return visitWhile(static_cast<While*>(o));
+    }
+  }
+
+  void visitFor(For* node)
+  {
+    visit(node->getInit());
+    visitForLoop(node);
+  }
+
+  // the for loop after its init
+  void visitForLoop(For* node)
+  {
+    enter(node);
+    while (test(node))
+    {
+      visit(node->getBody());
+      visit(node->getStep());
+      if (Loop* o = promoted(node))
+        return visitForLoop(static_cast<For*>(o));
+    }
+  }
+
+  // whether a loop goes round again
+  inline bool test(Loop* node)
+  {
+    if (metered)
+      meter.charge(node->getCost());
+    return visit(node->getCondition()).isTrue();
+  }
+
+  // counts an iteration of a loop, giving its optimized copy to carry on
+  // with if it's hot and the copy is ready. Only the thread owning the pool
+  // promotes, as promoting resets the loops around the copy, which loops
+  // run at once by the workers share.
+  Loop* promoted(Loop* node)
+  {
+    if (!tiering.enabled)
+      return nullptr;
+    const uint64_t n = node->iterate();
+    if (n < tiering.iterations)
+      return nullptr;
+    if (n == tiering.iterations)
+      request();
+    if (pool && std::this_thread::get_id() != owner)
+      return nullptr;
+    // the copy is only read once it's been published, and is its own copy
+    if (!optimized.load(std::memory_order_acquire) || !node->getOptimized())
+      return nullptr;
+    // The loops around the copy were never entered, so what their optimized
+    // nodes remember is from the last time it was promoted, if ever. What
+    // they depend on can't change until the copy's done, so they can be
+    // worked out afresh from here.
+    Loop* o = node->getOptimized();
+    for (Loop* l = o->getOuter(); l; l = l->getOuter())
+      enter(l);
+    return o;
+  }
+
+  // forgets what the loop's optimized nodes remember from its last run
+  void enter(Loop* node)
+  {
+    for (Hoisted* h : node->getHoisted())
+      h->reset();
+    for (Induction* i : node->getInductions())
+      i->reset();
+  }
+
+  Value visitHoisted(Hoisted* node)
+  {
+    if (!node->isValid())
+      node->setValue(visit(node->getNode()));
+    return node->getValue();
   }
 
-  void interpret()
+  Value visitInduction(Induction* node)
   {
+    if (node->isValid())
+      return node->getProduct();
+    AST* l = node->getVariable();
+    AST* r = node->getFactor();
+    if (node->isReversed())
+      std::swap(l, r);
+    const Value lv = visit(l);
+    const Value rv = visit(r);
+    const Value product = Value::multiply(lv, rv);
+    node->start(node->isReversed() ? lv : rv, product);
+    return product;
+  }
+
+  void visitStep(Step* node)
+  {
+    visitAssign(node->getAssign());
+    // a product is only kept while the variable is an integer
+    const bool exact = GLOBAL_SCOPE.get(node->getAssign()->getSlot()).isInt();
+    for (Induction* i : node->getInductions())
+    {
+      if (exact)
+        i->advance();
+      else
+        i->reset();
+    }
+  }
+
+  // parses the program, and optimizes it unless that's left until it's hot
+  void compile()
+  {
+    parser->setBudget(budget);
     tree = parser->parse();
-    visit(tree);
+    price(tree);
+    GLOBAL_SCOPE.resolve(tree, !global, !pool);
+    Inference inference;
+    inference.infer(tree);
+    integers = inference.getIntegers();
+    if (!tiering.enabled)
+      tree = Optimizer(options).optimize(tree);
+  }
+
+  // with tiering, moves the program to the optimized tree now rather than
+  // when it's hot
+  void optimize()
+  {
+    if (!tiering.enabled)
+      return;
+    request();
+    compiler->wait();
+  }
+
+  // compiles the program into a shared object at path with the system
+  // compiler, and runs that from now on
+  void compileNative(const std::string& path)
+  {
+    Native::build(Codegen().generate(tree, GLOBAL_SCOPE), path);
+    loadNative(path);
+  }
+
+  // runs a shared object compiled from the same script from now on
+  void loadNative(const std::string& path)
+  {
+    if (metered)
+      error("native code can't be given a budget");
+    if (published)
+      error("native code can't publish its variables");
+    native.reset(new Native(path, GLOBAL_SCOPE));
+  }
+
+  // Limits what compiling and each run may use from now on. Exceeding it
+  // throws a Budget::Exceeded, leaving the variables as they were at that
+  // point. Fuel and time aren't checked in native code, so can't be set
+  // with it.
+  void setBudget(const Budget& b)
+  {
+    if (native && b.metered())
+      error("native code can't be given a budget");
+    budget = b;
+    metered = budget.metered();
+  }
+  inline const Budget& getBudget() const { return budget; };
+
+  // Makes every variable global, as they were before blocks had variables
+  // of their own, when compiling from now on.
+  inline void setGlobalScope(const bool g) { global = g; };
+
+  void run()
+  {
+    if (native)
+      return native->run(GLOBAL_SCOPE);
+    if (metered)
+      meter.start(budget);
+    if (tiering.enabled && ++runs == tiering.runs)
+      request();
+    AST* t = optimized.load(std::memory_order_acquire);
+    if (pool)
+      GLOBAL_SCOPE.unshare();
+    visit(t ? t : tree);
+  }
+
+  // whether the program runs optimized from now on
+  inline bool isOptimized() const { return optimized.load(std::memory_order_acquire); };
 
-    for (auto&& it : GLOBAL_SCOPE)
-      std::cout << it.first << ": " << it.second << "\n";
+  // Makes a variable of the compiled program read from and write to
+  // *location, or stop doing so when it's nullptr. False if the program has
+  // no such variable.
+  bool bind(const std::string& name, double* location)
+  {
+    const uint32_t slot = GLOBAL_SCOPE.find(name);
+    if (slot == Scope::NOT_FOUND)
+      return false;
+    GLOBAL_SCOPE.bind(slot, location);
+    return true;
+  }
+
+  // the current value of a variable, NONE if it has none
+  Value get(const std::string& name) const
+  {
+    const uint32_t slot = GLOBAL_SCOPE.find(name);
+    return slot == Scope::NOT_FOUND ? Value() : GLOBAL_SCOPE.get(slot);
+  }
+
+  inline const Scope& getScope() const { return GLOBAL_SCOPE; };
+  // how many of the program's operators were inferred to be INT
+  inline uint64_t getIntegers() const { return integers; };
+
+  // what the program was parsed by
+  inline const Parser* getParser() const { return parser; };
+
+  // Publishes the variables of the compiled program, and every assignment
+  // to them from now on, for other threads to read while it runs (see
+  // Published). What's given stays valid for as long as it's held, even
+  // after the interpreter's gone. Writes to bound doubles by their owner
+  // aren't seen until the script next assigns them.
+  std::shared_ptr<const Published> publish()
+  {
+    if (!tree)
+      error("can't publish before compiling");
+    if (native)
+      error("native code can't publish its variables");
+    if (!published)
+      published = std::make_shared<Published>(GLOBAL_SCOPE);
+    return published;
+  }
+
+  // the variables as they are now, with the script if program
+  Snapshot snapshot(const bool program = false) const
+  {
+    if (program)
+      return Snapshot(GLOBAL_SCOPE, parser->getText(), parser->getFile());
+    return Snapshot(GLOBAL_SCOPE);
+  }
+
+  // Sets the variables to those of a snapshot. Before compiling, this shares
+  // the snapshot's memory; after, its values are copied in by name and
+  // variables it doesn't have are left be.
+  void restore(const Snapshot& s)
+  {
+    if (GLOBAL_SCOPE.size() == 0)
+    {
+      GLOBAL_SCOPE = s.getScope();
+      return;
+    }
+    const Scope& from = s.getScope();
+    for (auto&& it : from.getNames())
+    {
+      const uint32_t slot = GLOBAL_SCOPE.declare(it.first);
+      GLOBAL_SCOPE.set(slot, from.get(it.second));
+      if (published && slot < published->size())
+        published->set(slot, GLOBAL_SCOPE.get(slot));
+    }
+  }
+
+  void interpret(const Output& output = Output())
+  {
+    compile();
+    run();
+    output.write(GLOBAL_SCOPE);
   }
 
 private:
+  // Sets the cost of each statement and loop condition of a parsed tree,
+  // giving how many nodes the tree has. Costs are of the parsed program so
+  // a budget runs out at the same point whether or not it's been optimized.
+  static uint32_t price(AST* node)
+  {
+    uint32_t n = 1;
+    switch (node->getType())
+    {
+      case AST::Type::OP_UNARY:
+        n += price(static_cast<UnaryOp*>(node)->getNode());
+      break;
+      case AST::Type::OP_BINARY:
+        n += price(static_cast<BinaryOp*>(node)->getLeft());
+        n += price(static_cast<BinaryOp*>(node)->getRight());
+      break;
+      case AST::Type::COMPOUND:
+        for (AST* child : static_cast<Compound*>(node)->getChildren())
+          n += price(child);
+      break;
+      case AST::Type::ASSIGN:
+        n += 1 + price(static_cast<Assign*>(node)->getRight());
+        node->setCost(n);
+      break;
+      case AST::Type::CALL:
+        for (AST* a : static_cast<Call*>(node)->getArgs())
+          n += price(a);
+      break;
+      case AST::Type::FOR:
+        n += price(static_cast<For*>(node)->getInit());
+        n += price(static_cast<For*>(node)->getStep());
+      // fall through
+      case AST::Type::WHILE:
+      {
+        const uint32_t condition = price(static_cast<Loop*>(node)->getCondition());
+        node->setCost(1 + condition);
+        n += condition + price(static_cast<Loop*>(node)->getBody());
+      }
+      break;
+      default:
+      break;
+    }
+    return n;
+  }
+
+  static const std::string& programOf(const Snapshot& s)
+  {
+    if (!s.hasProgram())
+      throw std::string("Interpreter: snapshot has no program");
+    return s.getSource();
+  }
+
+  // starts optimizing a copy of the tree in the background, the first time
+  // it's called
+  void request()
+  {
+    if (requested.exchange(true))
+      return;
+    compiler.reset(new ThreadPool(1));
+    compiler->submit([this]() {
+      AST* copy = tree->clone();
+      link(tree, copy, nullptr);
+      optimized.store(Optimizer(options).optimize(copy), std::memory_order_release);
+    });
+  }
+
+  // points the loops of a tree at the same loops in its copy, which the
+  // Optimizer keeps, and the copy's loops at the loops they're in
+  static void link(AST* node, AST* copy, Loop* outer)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::COMPOUND:
+      {
+        const std::vector<AST*>& a = static_cast<Compound*>(node)->getChildren();
+        const std::vector<AST*>& b = static_cast<Compound*>(copy)->getChildren();
+        for (std::vector<AST*>::size_type i = 0; i < a.size(); ++i)
+          link(a[i], b[i], outer);
+      }
+      break;
+      case AST::Type::WHILE:
+      case AST::Type::FOR:
+        static_cast<Loop*>(node)->setOptimized(static_cast<Loop*>(copy));
+        static_cast<Loop*>(copy)->setOuter(outer);
+        link(static_cast<Loop*>(node)->getBody(), static_cast<Loop*>(copy)->getBody(), static_cast<Loop*>(copy));
+      break;
+      default:
+      break;
+    }
+  }
+
+  // Overflow is thrown by the integer path when +, - or * of integers
+  // overflows, or an INT subtree turns out not to be an integer because one
+  // did earlier. The Value path then works it out again, promoting to REAL.
+  struct Overflow {};
+
+  static const int64_t COMPARISONS = Token::LESS | Token::GREATER | Token::LESS_EQUAL |
+                                     Token::GREATER_EQUAL | Token::EQUAL | Token::NOT_EQUAL;
+
   Parser* parser;
   AST* tree;
-  std::map<std::string, double> GLOBAL_SCOPE;
+  Optimizer::Options options;
+  Scope GLOBAL_SCOPE;
+  bool global; // whether blocks have no variables of their own
+  uint64_t integers; // operators on the integer path
+
+  Budget budget;
+  Budget::Meter meter;
+  bool metered; // whether the budget needs counting as it runs
+
+  Tiering tiering;
+  uint64_t runs;
+  std::atomic<bool> requested;
+  std::atomic<AST*> optimized;
+  std::unique_ptr<ThreadPool> compiler;
+  std::unique_ptr<Native> native;
+  std::shared_ptr<Published> published; // if publishing
+
+  std::unique_ptr<ThreadPool> pool;
+  std::thread::id owner;
+  std::map<Compound*, std::unique_ptr<Schedule>> schedules;
 };
 
 
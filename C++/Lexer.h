@@ -1,24 +1,68 @@
 #ifndef LEXER_H_INCLUDE
 #define LEXER_H_INCLUDE
 
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "Token.h"
 
 class Lexer
 {
 public:
-  Lexer(const std::string& t, const std::string& f) : text(t), file(f), pos(0), current(t[0]), line(1), lpos(1) {};
+  // where the lexer is in the text
+  struct Position
+  {
+    std::string::size_type pos;
+    int32_t line;
+    int32_t lpos;
+  };
+
+  // the extent of a block, from its `{` up to just past its `}`
+  struct Span
+  {
+    Position begin;
+    Position end;
+  };
+
+  // Where the text comes from when it's still being read in as it's lexed,
+  // see Pipeline. Both wait, and can be called from any thread.
+  class Stream
+  {
+  public:
+    virtual ~Stream() {};
+    // how much of the text there is once there's more than `have` of it,
+    // or the whole of it
+    virtual std::string::size_type more(const std::string::size_type have) = 0;
+    // how much text there is once it's all been read
+    virtual std::string::size_type all() = 0;
+  };
+
+  Lexer(const std::string& t, const std::string& f) : text(std::make_shared<const std::string>(t)), file(f), stream(nullptr), end(t.length()), pos(0), current(t[0]), line(1), lpos(1), start(0) {};
+  // lexes text as s says it's there
+  Lexer(const std::shared_ptr<const std::string>& t, const std::string& f, Stream* s) : text(t), file(f), stream(s), end(0), pos(0), line(1), lpos(1), start(0)
+  {
+    current = available(0) ? (*text)[0] : 0;
+  };
+  // lexes just [begin, e) of another lexer's text, but reports positions and
+  // errors within the whole of it
+  Lexer(const Lexer& l, const Position& begin, const std::string::size_type e) : text(l.text), file(l.file), stream(nullptr), end(e), start(begin.pos)
+  {
+    seek(begin);
+  };
   ~Lexer() {};
 
-  std::string println(int32_t ln, int32_t lp)
+  std::string println(int32_t ln, int32_t lp) const
   {
     int32_t i = 1;
     int32_t index = 0;
     while (i < ln)
     {
-      index = text.find("\n", index+1) + 1;
+      index = text->find("\n", index+1) + 1;
       ++i;
     }
-    std::string line = text.substr(index, text.find("\n", index) - index) + "\n";
+    std::string line = text->substr(index, text->find("\n", index) - index) + "\n";
 
     if (lp >= 0)
     {
@@ -30,37 +74,45 @@ public:
     return line;
   }
 
-  std::string at()
+  std::string at(int32_t ln, int32_t lp) const
   {
     std::stringstream ss;
     if (file.length())
       ss << file;
     else
       ss << "STDIN";
-     ss << ":" << line << ":" << lpos;
+     ss << ":" << ln << ":" << lp;
     return ss.str();
   }
 
+  // a message about position p, of the given kind ("error", "warning")
+  std::string report(const Position& p, const std::string& kind, const std::string& msg) const
+  {
+    if (stream)
+      stream->all(); // to show the line
+    return at(p.line, p.lpos) + ": " + kind + ": " + msg + "\n" + println(p.line, p.lpos);
+  }
+
   void warning(const std::string& msg)
   {
-    std::cout << at() << ": warning: " << msg << "\n" << println(line, lpos);
+    std::cout << report(here(), "warning", msg);
   }
   void error(const std::string& msg)
   {
-    throw at() + std::string(": error: ") + msg + "\n" + println(line, lpos);
+    throw report(here(), "error", msg);
   }
 
   void advance()
   {
     ++pos;
     ++lpos;
-    if (pos >= text.length())
+    if (!available(pos))
     {
       current = 0;
     }
     else
     {
-      current = text[pos];
+      current = (*text)[pos];
       if (current == '\n')
       {
         ++line;
@@ -71,9 +123,9 @@ public:
 
   char peek()
   {
-    if (pos+1 >= text.length())
+    if (!available(pos+1))
       return 0;
-    return text[pos+1];
+    return (*text)[pos+1];
   }
 
   void skipWhitespace()
@@ -97,10 +149,16 @@ public:
       advance();
     }
 
+    if (name == "while")
+      return new TokenWhile();
+    if (name == "for")
+      return new TokenFor();
     return new TokenID(name);
   }
 
-  double number()
+  // integer literals are kept exact, anything with a fraction (or too big
+  // for an int64_t) becomes a double
+  Value number()
   {
     std::string ret;
     while (current && std::isdigit(current))
@@ -108,7 +166,25 @@ public:
       ret += current;
       advance();
     }
-    return std::stod(ret);
+    if (current == '.' && std::isdigit(peek()))
+    {
+      ret += current;
+      advance();
+      while (current && std::isdigit(current))
+      {
+        ret += current;
+        advance();
+      }
+      return Value(std::stod(ret));
+    }
+    try
+    {
+      return Value(static_cast<int64_t>(std::stoll(ret)));
+    }
+    catch (const std::out_of_range&)
+    {
+      return Value(std::stod(ret));
+    }
   }
 
   Token* nextToken()
@@ -125,6 +201,7 @@ public:
         skipComment();
         continue;
       }
+      start = pos;
       if (std::isdigit(current))
         return new TokenNumber(number());
 
@@ -191,6 +268,40 @@ public:
         advance();
         return new TokenBitshiftR();
       }
+      if (current == '<' && peek() == '=')
+      {
+        advance();
+        advance();
+        return new TokenLessEqual();
+      }
+      if (current == '>' && peek() == '=')
+      {
+        advance();
+        advance();
+        return new TokenGreaterEqual();
+      }
+      if (current == '<')
+      {
+        advance();
+        return new TokenLess();
+      }
+      if (current == '>')
+      {
+        advance();
+        return new TokenGreater();
+      }
+      if (current == '=' && peek() == '=')
+      {
+        advance();
+        advance();
+        return new TokenEqual();
+      }
+      if (current == '!' && peek() == '=')
+      {
+        advance();
+        advance();
+        return new TokenNotEqual();
+      }
       if (current == '(')
       {
         advance();
@@ -216,6 +327,11 @@ public:
         advance();
         return new TokenSemicolon();
       }
+      if (current == ',')
+      {
+        advance();
+        return new TokenComma();
+      }
       if (std::isalpha(current))
         return id();
       if (current == '=')
@@ -226,16 +342,87 @@ public:
 
       error(std::string("unexpected character: `") + current + "`");
     }
+    start = pos;
     return new TokenEOF();
   }
 
+  // all of the text, even if lexing just part of it
+  inline const std::string& getText() const
+  {
+    if (stream)
+      stream->all();
+    return *text;
+  };
+  inline const std::string& getFile() const { return file; };
+
+  inline Position here() const { return Position{pos, line, lpos}; };
+  // where the last token returned by nextToken started
+  inline std::string::size_type tokenStart() const { return start; };
+
+  void seek(const Position& p)
+  {
+    pos = p.pos;
+    line = p.line;
+    lpos = p.lpos;
+    current = available(pos) ? (*text)[pos] : 0;
+  }
+
+  // Finds the blocks nested directly in top level blocks, without lexing
+  // them, from here on with `open` blocks already begun, as the top level
+  // one is once its { has been lexed. Walks the text exactly as nextToken
+  // would, so comments are skipped the same way and positions match.
+  std::vector<Span> blocks(const int32_t open = 0) const
+  {
+    std::vector<Span> spans;
+    Lexer scan(*this, here(), end);
+    int32_t depth = open;
+    while (scan.current)
+    {
+      if (scan.current == '/' && (scan.peek() == '/' || scan.peek() == '*'))
+      {
+        scan.skipComment();
+        continue;
+      }
+      if (scan.current == '{' && ++depth == 2)
+        spans.push_back(Span{scan.here(), scan.here()});
+      const bool closing = scan.current == '}' && depth-- == 2;
+      scan.advance();
+      if (closing)
+        spans.back().end = scan.here();
+      if (depth < 0)
+        depth = 0;
+    }
+    // an unterminated block is left for the parser to complain about
+    if (depth >= 2)
+      spans.pop_back();
+    return spans;
+  }
+
 private:
-  std::string text;
+  // whether there's text at p, waiting on the stream for it if need be
+  inline bool available(const std::string::size_type p)
+  {
+    while (p >= end)
+    {
+      if (!stream)
+        return false;
+      const std::string::size_type more = stream->more(end);
+      if (more <= end)
+        return false;
+      end = more;
+    }
+    return true;
+  }
+
+  std::shared_ptr<const std::string> text;
   std::string file;
+  Stream* stream; // null when all the text is there from the start
+  std::string::size_type end;
   std::string::size_type pos;
   char current;
   int32_t line;
   int32_t lpos;
+  std::string::size_type start;
 };
 
 #endif
@@ -0,0 +1,199 @@
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <utility>
+
+#include "Interpreter.h"
+#include "Library.h"
+
+struct interpreter_program
+{
+  interpreter_program(Interpreter* i) : interpreter(i) {};
+  ~interpreter_program() { delete interpreter; };
+
+  Interpreter* interpreter;
+  std::shared_ptr<const Published> published; // set once, before it's read
+};
+
+static void report(const std::string& msg, char* error, const size_t size)
+{
+  if (!error || size == 0)
+    return;
+  std::strncpy(error, msg.c_str(), size - 1);
+  error[size - 1] = '\0';
+}
+
+interpreter_program* interpreter_compile(const char* script, const char* name, char* error, size_t size)
+{
+  return interpreter_compile_budgeted(script, name, nullptr, error, size);
+}
+
+interpreter_program* interpreter_compile_budgeted(const char* script, const char* name, const interpreter_budget* budget, char* error, size_t size)
+{
+  Interpreter* interpreter = nullptr;
+  try
+  {
+    interpreter = new Interpreter(new Parser(new Lexer(script, name ? name : "")));
+    if (budget)
+    {
+      Budget b;
+      b.fuel = budget->fuel;
+      b.memory = budget->memory;
+      b.milliseconds = budget->milliseconds;
+      b.nesting = budget->nesting;
+      interpreter->setBudget(b);
+    }
+    interpreter->compile();
+    return new interpreter_program(interpreter);
+  }
+  catch (std::string e)
+  {
+    report(e, error, size);
+  }
+  catch (const std::exception& e)
+  {
+    report(e.what(), error, size);
+  }
+  delete interpreter;
+  return nullptr;
+}
+
+int interpreter_bind(interpreter_program* program, const char* variable, double* location)
+{
+  return program->interpreter->bind(variable, location) ? 0 : -1;
+}
+
+int interpreter_run(interpreter_program* program, char* error, size_t size)
+{
+  try
+  {
+    program->interpreter->run();
+    return 0;
+  }
+  catch (Budget::Exceeded e)
+  {
+    report(e, error, size);
+    return -2;
+  }
+  catch (std::string e)
+  {
+    report(e, error, size);
+  }
+  catch (const std::exception& e)
+  {
+    report(e.what(), error, size);
+  }
+  return -1;
+}
+
+int interpreter_get(const interpreter_program* program, const char* variable, double* value)
+{
+  const Value v = program->interpreter->get(variable);
+  if (v.isNone())
+    return -1;
+  *value = v.toReal();
+  return 0;
+}
+
+int interpreter_publish(interpreter_program* program, char* error, size_t size)
+{
+  try
+  {
+    program->published = program->interpreter->publish();
+    return 0;
+  }
+  catch (std::string e)
+  {
+    report(e, error, size);
+  }
+  return -1;
+}
+
+int interpreter_read(const interpreter_program* program, const char* variable, double* value)
+{
+  if (!program->published)
+    return -1;
+  const Value v = program->published->get(variable);
+  if (v.isNone())
+    return -1;
+  *value = v.toReal();
+  return 0;
+}
+
+void interpreter_free(interpreter_program* program)
+{
+  delete program;
+}
+
+// interpreter_map's loops, one per builtin, over doubles only so the library
+// (built with -O3 -fno-math-errno) vectorises them
+struct Maps
+{
+  typedef void (*Map)(const double* const* args, double* out, size_t n);
+
+  // the loop for a builtin, nullptr if there isn't one
+  static Map find(const char* name)
+  {
+    static const std::pair<const char*, Map> maps[] = {
+      {"abs",   &map<fabs>},
+      {"sqrt",  &map<sqrt>},
+      {"exp",   &map<exp>},
+      {"log",   &map<log>},
+      {"log10", &map<log10>},
+      {"sin",   &map<sin>},
+      {"cos",   &map<cos>},
+      {"tan",   &map<tan>},
+      {"floor", &map<floor>},
+      {"ceil",  &map<ceil>},
+      {"min",   &map<fmin>},
+      {"max",   &map<fmax>}
+    };
+    for (const std::pair<const char*, Map>& m : maps)
+    {
+      if (std::strcmp(m.first, name) == 0)
+        return m.second;
+    }
+    return nullptr;
+  }
+
+  template <double (*F)(double)>
+  static void map(const double* const* args, double* out, size_t n)
+  {
+    const double* a = args[0];
+    for (size_t i = 0; i < n; ++i)
+      out[i] = F(a[i]);
+  }
+
+  template <double (*F)(double, double)>
+  static void map(const double* const* args, double* out, size_t n)
+  {
+    const double* a = args[0];
+    const double* b = args[1];
+    for (size_t i = 0; i < n; ++i)
+      out[i] = F(a[i], b[i]);
+  }
+
+  // wrappers, as the <cmath> names are overloaded
+  static double fabs(double x) { return std::fabs(x); };
+  static double sqrt(double x) { return std::sqrt(x); };
+  static double exp(double x) { return std::exp(x); };
+  static double log(double x) { return std::log(x); };
+  static double log10(double x) { return std::log10(x); };
+  static double sin(double x) { return std::sin(x); };
+  static double cos(double x) { return std::cos(x); };
+  static double tan(double x) { return std::tan(x); };
+  static double floor(double x) { return std::floor(x); };
+  static double ceil(double x) { return std::ceil(x); };
+  static double fmin(double x, double y) { return std::fmin(x, y); };
+  static double fmax(double x, double y) { return std::fmax(x, y); };
+};
+
+int interpreter_map(const char* function, const double* const* args, double* out, size_t n)
+{
+  const Maps::Map map = Maps::find(function);
+  if (!map)
+    return -1;
+  map(args, out, n);
+  return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef LIBRARY_H_INCLUDE
+#define LIBRARY_H_INCLUDE
+
+/*
+ * C interface to the interpreter, built into libinterpreter by `make lib`.
+ *
+ * A script is compiled once and can then be run any number of times.
+ * Variables can be bound to doubles owned by the caller: a bound variable
+ * the script reads is an input, one it assigns is an output, and neither
+ * goes through any copy. Running allocates nothing unless it fails, apart
+ * from once when the program is hot and gets optimized on a background
+ * thread. Variables keep their values between runs.
+ *
+ * A program must only be used by one thread at a time, except that once
+ * published its variables can be read by any thread with interpreter_read,
+ * even while it runs.
+ *
+ * Functions taking an error buffer write a message into it on failure,
+ * truncated to size (it may be NULL).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct interpreter_program interpreter_program;
+
+/* compiles a script, name is used in error messages, NULL on failure */
+interpreter_program* interpreter_compile(const char* script, const char* name, char* error, size_t size);
+
+/* limits on what compiling and each run may use, 0 for no limit */
+typedef struct interpreter_budget
+{
+  uint64_t fuel;         /* nodes evaluated in a run */
+  uint64_t memory;       /* bytes the tokens and tree may take */
+  uint64_t milliseconds; /* wall clock time */
+  uint32_t nesting;      /* how deeply statements and expressions may nest */
+} interpreter_budget;
+
+/* compiles a script as interpreter_compile does, keeping to budget then and
+ * in every run (NULL for no limits) */
+interpreter_program* interpreter_compile_budgeted(const char* script, const char* name, const interpreter_budget* budget, char* error, size_t size);
+
+/* makes the variable read from and write to *location from now on, or stop
+ * doing so if location is NULL. 0 on success, -1 if there's no such variable */
+int interpreter_bind(interpreter_program* program, const char* variable, double* location);
+
+/* runs the program, 0 on success, -1 on failure, -2 if it ran out of budget */
+int interpreter_run(interpreter_program* program, char* error, size_t size);
+
+/* the current value of a variable, 0 on success, -1 if it has no value */
+int interpreter_get(const interpreter_program* program, const char* variable, double* value);
+
+/* publishes the variables for interpreter_read from now on (not for a
+ * program compiled natively), 0 on success, -1 on failure */
+int interpreter_publish(interpreter_program* program, char* error, size_t size);
+
+/* the value a published variable had when last assigned, from any thread,
+ * never waiting on the program. 0 on success, -1 if it has no value or the
+ * program isn't published */
+int interpreter_read(const interpreter_program* program, const char* variable, double* value);
+
+void interpreter_free(interpreter_program* program);
+
+/* applies a builtin function (sqrt, exp, min, ...) to n elements of each of
+ * its argument arrays at once, writing n results to out. 0 on success, -1 if
+ * there's no such function. */
+int interpreter_map(const char* function, const double* const* args, double* out, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef NATIVE_H_INCLUDE
+#define NATIVE_H_INCLUDE
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "Scope.h"
+#include "Value.h"
+
+// where the generated code finds Value.h and Builtins.h, set by the Makefile
+#ifndef NATIVE_INCLUDE
+#define NATIVE_INCLUDE "."
+#endif
+
+// A program compiled ahead of time by the system compiler into a shared
+// object (see Codegen), loaded and run on the variables of a Scope.
+// Only supported where there's dlopen.
+class Native
+{
+public:
+  // compiles generated source into a shared object at path, using $CXX or c++
+  static void build(const std::string& source, const std::string& path)
+  {
+    if (path.find('\'') != std::string::npos)
+      throw std::string("Native: bad path: ") + path;
+    const std::string file = path + ".cpp";
+    {
+      std::ofstream out(file.c_str());
+      out << source;
+      if (!out.good())
+        throw std::string("Native: failed to write ") + file;
+    }
+
+    const char* cxx = std::getenv("CXX");
+    // no contraction into fma, which the interpreter doesn't do either
+    const std::string command = std::string(cxx ? cxx : "c++") +
+      " -std=c++17 -O2 -ffp-contract=off -shared -fPIC -I'" NATIVE_INCLUDE "' -o '" + path + "' '" + file + "'";
+    const int status = std::system(command.c_str());
+    std::remove(file.c_str());
+    if (status != 0)
+      throw std::string("Native: failed to compile ") + path;
+  }
+
+  // loads a shared object built from the script scope was resolved from
+  Native(const std::string& path, Scope& scope) : handle(nullptr), function(nullptr)
+  {
+#ifdef _WIN32
+    (void)scope;
+    throw std::string("Native: not supported on this platform: ") + path;
+#else
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+      throw std::string("Native: ") + dlerror();
+    function = reinterpret_cast<Function>(dlsym(handle, "interpreter_native_run"));
+    const unsigned* count = static_cast<const unsigned*>(dlsym(handle, "interpreter_native_count"));
+    const char* const* names = static_cast<const char* const*>(dlsym(handle, "interpreter_native_names"));
+    if (!function || !count || !names)
+    {
+      dlclose(handle);
+      throw std::string("Native: not a compiled script: ") + path;
+    }
+    // blocks' variables have no name, and no slot outside the object
+    for (unsigned i = 0; i < *count; ++i)
+      slots.push_back(*names[i] ? scope.declare(names[i]) : Scope::NOT_FOUND);
+    values.resize(slots.size());
+#endif
+  };
+  ~Native()
+  {
+#ifndef _WIN32
+    if (handle)
+      dlclose(handle);
+#endif
+  };
+
+  Native(const Native&) = delete;
+  Native& operator=(const Native&) = delete;
+
+  void run(Scope& scope)
+  {
+    for (std::vector<uint32_t>::size_type i = 0; i < slots.size(); ++i)
+      values[i] = slots[i] == Scope::NOT_FOUND ? Value() : scope.get(slots[i]);
+
+    char error[256];
+    const int status = function(values.data(), error, sizeof(error));
+
+    for (std::vector<uint32_t>::size_type i = 0; i < slots.size(); ++i)
+    {
+      if (!values[i].isNone() && slots[i] != Scope::NOT_FOUND)
+        scope.set(slots[i], values[i]);
+    }
+    if (status != 0)
+      throw std::string(error);
+  }
+
+private:
+  typedef int (*Function)(Value* variables, char* error, std::size_t size);
+
+  void* handle;
+  Function function;
+  std::vector<uint32_t> slots; // the Scope slot of each of the object's variables
+  std::vector<Value> values;
+};
+
+#endif
@@ -0,0 +1,632 @@
+#ifndef OPTIMIZER_H_INCLUDE
+#define OPTIMIZER_H_INCLUDE
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "AST.h"
+#include "Inference.h"
+#include "Token.h"
+#include "Value.h"
+
+// Rewrites a (type inferred) tree into one that's cheaper to evaluate.
+// Every rewrite takes ownership of the node it's given and returns the node
+// to use in its place.
+class Optimizer
+{
+public:
+  struct Options
+  {
+    Options() : strictFP(true), fuse(true), loops(true) {};
+
+    // only allow rewrites that give bit-identical floating point results
+    bool strictFP;
+    // combine common operator shapes into single nodes
+    bool fuse;
+    // hoist loop invariants and strength reduce induction variables
+    bool loops;
+  };
+
+  Optimizer(const Options& o) : options(o) {};
+  ~Optimizer() {};
+
+  AST* optimize(AST* node)
+  {
+    node = rewrite(node);
+    if (options.loops)
+      loops(node);
+    if (options.fuse)
+      node = fuse(node);
+    return node;
+  }
+
+private:
+  // bottom up simplification
+  AST* rewrite(AST* node)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::OP_UNARY:
+        return optimizeUnaryOp(static_cast<UnaryOp*>(node));
+      case AST::Type::OP_BINARY:
+        return optimizeBinaryOp(static_cast<BinaryOp*>(node));
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        for (std::vector<AST*>::size_type i = 0; i < c->getChildren().size(); ++i)
+          c->replace(i, rewrite(c->getChildren()[i]));
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        a->setRight(rewrite(a->getRight()));
+      }
+      break;
+      case AST::Type::CALL:
+        return rewriteCall(static_cast<Call*>(node));
+      case AST::Type::FOR:
+      {
+        For* f = static_cast<For*>(node);
+        f->setInit(rewrite(f->getInit()));
+        f->setStep(rewrite(f->getStep()));
+      }
+      // fall through
+      case AST::Type::WHILE:
+      {
+        Loop* l = static_cast<Loop*>(node);
+        l->setCondition(rewrite(l->getCondition()));
+        l->setBody(rewrite(l->getBody()));
+      }
+      break;
+      default:
+      break;
+    }
+    return node;
+  }
+
+  // folds signs into literals, so `x ** -1` has a constant exponent
+  AST* optimizeUnaryOp(UnaryOp* node)
+  {
+    node->setNode(rewrite(node->getNode()));
+    if (node->getNode()->getType() != AST::NUMBER ||
+        !(node->tokenType() & (Token::ADDITION|Token::SUBTRACTION)))
+      return node;
+
+    Value v = static_cast<Number*>(node->getNode())->getValue();
+    if (node->tokenType() == Token::SUBTRACTION)
+      v = Value::negate(v);
+    delete node;
+    return number(v);
+  }
+
+  AST* optimizeBinaryOp(BinaryOp* node)
+  {
+    node->setLeft(rewrite(node->getLeft()));
+    node->setRight(rewrite(node->getRight()));
+    if (node->tokenType() == Token::POWER && node->getRight()->getType() == AST::NUMBER)
+      return optimizePower(node);
+    return node;
+  }
+
+  // calls on constants are worked out now
+  AST* rewriteCall(Call* node)
+  {
+    bool constant = true;
+    for (std::vector<AST*>::size_type i = 0; i < node->getArgs().size(); ++i)
+    {
+      node->setArg(i, rewrite(node->getArgs()[i]));
+      constant = constant && node->getArgs()[i]->getType() == AST::NUMBER;
+    }
+    if (!constant)
+      return node;
+
+    Value args[Builtin::MAX_ARITY];
+    for (std::vector<AST*>::size_type i = 0; i < node->getArgs().size(); ++i)
+      args[i] = static_cast<Number*>(node->getArgs()[i])->getValue();
+    const Value v = node->getBuiltin()->scalar(args);
+    delete node;
+    return number(v);
+  }
+
+  AST* optimizePower(BinaryOp* node)
+  {
+    const Value& e = static_cast<Number*>(node->getRight())->getValue();
+    PowerOp::Kernel kernel;
+    int64_t n = 0;
+    if (e.isInt())
+    {
+      n = e.toInt();
+      // pow(x, 0) is 1 for every x, but nothing promises pow gives exactly
+      // x, x * x or 1 / x for anything else
+      if (n == 0)
+        kernel = PowerOp::ZERO;
+      else if (options.strictFP)
+        kernel = PowerOp::INTEGER;
+      else if (n == 1)
+        kernel = PowerOp::ONE;
+      else if (n == 2)
+        kernel = PowerOp::SQUARE;
+      else if (n == -1)
+        kernel = PowerOp::RECIPROCAL;
+      else
+        kernel = PowerOp::SQUARING;
+    }
+    else if (e.toReal() == 0.5 && !options.strictFP)
+    {
+      kernel = PowerOp::SQRT;
+    }
+    else
+    {
+      return node;
+    }
+
+    AST* base = node->getLeft();
+    node->setLeft(nullptr);
+    delete node;
+
+    PowerOp* p = new PowerOp(base, kernel, n);
+    p->setKind(Inference::powerKind(kernel, base->getKind()));
+    return p;
+  }
+
+  // top down, so `a * b + c` is claimed before `a * b` can become a var op
+  AST* fuse(AST* node)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::OP_UNARY:
+      {
+        UnaryOp* u = static_cast<UnaryOp*>(node);
+        u->setNode(fuse(u->getNode()));
+      }
+      break;
+      case AST::Type::OP_BINARY:
+        return fuseBinaryOp(static_cast<BinaryOp*>(node));
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        for (std::vector<AST*>::size_type i = 0; i < c->getChildren().size(); ++i)
+          c->replace(i, fuse(c->getChildren()[i]));
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        a->setRight(fuse(a->getRight()));
+      }
+      break;
+      case AST::Type::OP_POWER:
+      {
+        PowerOp* p = static_cast<PowerOp*>(node);
+        p->setBase(fuse(p->getBase()));
+      }
+      break;
+      case AST::Type::CALL:
+      {
+        Call* c = static_cast<Call*>(node);
+        for (std::vector<AST*>::size_type i = 0; i < c->getArgs().size(); ++i)
+          c->setArg(i, fuse(c->getArgs()[i]));
+      }
+      break;
+      case AST::Type::FOR:
+      {
+        For* f = static_cast<For*>(node);
+        f->setInit(fuse(f->getInit()));
+        f->setStep(fuse(f->getStep()));
+      }
+      // fall through
+      case AST::Type::WHILE:
+      {
+        Loop* l = static_cast<Loop*>(node);
+        l->setCondition(fuse(l->getCondition()));
+        l->setBody(fuse(l->getBody()));
+      }
+      break;
+      case AST::Type::HOISTED:
+      {
+        Hoisted* h = static_cast<Hoisted*>(node);
+        h->setNode(fuse(h->getNode()));
+      }
+      break;
+      case AST::Type::INDUCTION:
+      {
+        Induction* i = static_cast<Induction*>(node);
+        i->setFactor(fuse(i->getFactor()));
+      }
+      break;
+      case AST::Type::STEP:
+        fuse(static_cast<Step*>(node)->getAssign());
+      break;
+      default:
+      break;
+    }
+    return node;
+  }
+
+  AST* fuseBinaryOp(BinaryOp* node)
+  {
+    AST* l = node->getLeft();
+    AST* r = node->getRight();
+    AST* fused = nullptr;
+    if (node->tokenType() == Token::ADDITION && l->getType() == AST::OP_BINARY &&
+        static_cast<BinaryOp*>(l)->tokenType() == Token::MULTIPLICATION)
+    {
+      BinaryOp* mul = static_cast<BinaryOp*>(l);
+      fused = new MulAddOp(fuse(mul->getLeft()), fuse(mul->getRight()), fuse(r), !options.strictFP);
+      mul->setLeft(nullptr);
+      mul->setRight(nullptr);
+      node->setRight(nullptr);
+    }
+    else if (l->getType() == AST::VARIABLE && r->getType() == AST::NUMBER)
+    {
+      fused = new VarConstOp(static_cast<Variable*>(l), node->tokenType(), static_cast<Number*>(r)->getValue(), false);
+      node->setLeft(nullptr);
+    }
+    else if (l->getType() == AST::NUMBER && r->getType() == AST::VARIABLE)
+    {
+      fused = new VarConstOp(static_cast<Variable*>(r), node->tokenType(), static_cast<Number*>(l)->getValue(), true);
+      node->setRight(nullptr);
+    }
+    else if (l->getType() == AST::VARIABLE && r->getType() == AST::VARIABLE)
+    {
+      fused = new VarVarOp(static_cast<Variable*>(l), node->tokenType(), static_cast<Variable*>(r));
+      node->setLeft(nullptr);
+      node->setRight(nullptr);
+    }
+    else
+    {
+      node->setLeft(fuse(l));
+      node->setRight(fuse(r));
+      return node;
+    }
+
+    fused->setKind(node->getKind());
+    delete node;
+    return fused;
+  }
+
+  // how many times each slot is assigned
+  typedef std::map<uint32_t, uint32_t> Writes;
+
+  // Loop invariant code motion and strength reduction. Outer loops go first,
+  // so invariants are hoisted as far out as they can be.
+  void loops(AST* node)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::COMPOUND:
+        for (AST* child : static_cast<Compound*>(node)->getChildren())
+          loops(child);
+      break;
+      case AST::Type::WHILE:
+      case AST::Type::FOR:
+        optimizeLoop(static_cast<Loop*>(node));
+      break;
+      default:
+      break;
+    }
+  }
+
+  void optimizeLoop(Loop* node)
+  {
+    For* f = node->getType() == AST::FOR ? static_cast<For*>(node) : nullptr;
+    Writes written;
+    writes(node->getCondition(), written);
+    writes(node->getBody(), written);
+    if (f)
+      writes(f->getStep(), written);
+
+    if (invariant(node->getCondition(), written, node))
+      node->setCondition(hoist(node->getCondition(), node));
+    invariant(node->getBody(), written, node);
+    if (f)
+      invariant(f->getStep(), written, node);
+
+    reduce(node, written);
+    loops(node->getBody());
+  }
+
+  void writes(AST* node, Writes& written)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::COMPOUND:
+        for (AST* child : static_cast<Compound*>(node)->getChildren())
+          writes(child, written);
+      break;
+      case AST::Type::ASSIGN:
+        ++written[static_cast<Assign*>(node)->getSlot()];
+      break;
+      case AST::Type::STEP:
+        writes(static_cast<Step*>(node)->getAssign(), written);
+      break;
+      case AST::Type::FOR:
+        writes(static_cast<For*>(node)->getInit(), written);
+        writes(static_cast<For*>(node)->getStep(), written);
+      // fall through
+      case AST::Type::WHILE:
+        writes(static_cast<Loop*>(node)->getBody(), written);
+      break;
+      default:
+      break;
+    }
+  }
+
+  // Whether a node is an expression none of whose variables the loop
+  // assigns. The largest such operations below a node that isn't are moved
+  // into Hoisted nodes of the loop.
+  bool invariant(AST* node, const Writes& written, Loop* loop)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::NUMBER:
+      case AST::Type::HOISTED:
+        return true;
+      case AST::Type::VARIABLE:
+        return !written.count(static_cast<Variable*>(node)->getSlot());
+      case AST::Type::OP_UNARY:
+        return invariant(static_cast<UnaryOp*>(node)->getNode(), written, loop);
+      case AST::Type::OP_BINARY:
+      {
+        BinaryOp* b = static_cast<BinaryOp*>(node);
+        const bool l = invariant(b->getLeft(), written, loop);
+        const bool r = invariant(b->getRight(), written, loop);
+        if (l && r)
+          return true;
+        if (l)
+          b->setLeft(hoist(b->getLeft(), loop));
+        if (r)
+          b->setRight(hoist(b->getRight(), loop));
+      }
+      break;
+      case AST::Type::OP_POWER:
+        return invariant(static_cast<PowerOp*>(node)->getBase(), written, loop);
+      case AST::Type::CALL:
+      {
+        Call* c = static_cast<Call*>(node);
+        std::vector<bool> args;
+        for (AST* a : c->getArgs())
+          args.push_back(invariant(a, written, loop));
+        if (std::find(std::begin(args), std::end(args), false) == std::end(args))
+          return true;
+        for (std::vector<AST*>::size_type i = 0; i < args.size(); ++i)
+        {
+          if (args[i])
+            c->setArg(i, hoist(c->getArgs()[i], loop));
+        }
+      }
+      break;
+      case AST::Type::COMPOUND:
+        for (AST* child : static_cast<Compound*>(node)->getChildren())
+          invariant(child, written, loop);
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        if (invariant(a->getRight(), written, loop))
+          a->setRight(hoist(a->getRight(), loop));
+      }
+      break;
+      case AST::Type::FOR:
+      {
+        For* f = static_cast<For*>(node);
+        invariant(f->getInit(), written, loop);
+        invariant(f->getStep(), written, loop);
+      }
+      // fall through
+      case AST::Type::WHILE:
+      {
+        Loop* l = static_cast<Loop*>(node);
+        if (invariant(l->getCondition(), written, loop))
+          l->setCondition(hoist(l->getCondition(), loop));
+        invariant(l->getBody(), written, loop);
+      }
+      break;
+      default:
+      break;
+    }
+    return false;
+  }
+
+  // an invariant expression, to be worked out once per entry of the loop
+  static AST* hoist(AST* node, Loop* loop)
+  {
+    // nothing to gain for leaves
+    if (node->getType() == AST::NUMBER || node->getType() == AST::VARIABLE || node->getType() == AST::HOISTED)
+      return node;
+    Hoisted* h = new Hoisted(node);
+    h->setKind(node->getKind());
+    loop->add(h);
+    return h;
+  }
+
+  // Strength reduces `i * k` for each variable i the loop only assigns in a
+  // top level `i = i + step` (or - step), for integer step and invariant k.
+  void reduce(Loop* node, const Writes& written)
+  {
+    For* f = node->getType() == AST::FOR ? static_cast<For*>(node) : nullptr;
+    std::vector<AST*> statements;
+    if (node->getBody()->getType() == AST::COMPOUND)
+      statements = static_cast<Compound*>(node->getBody())->getChildren();
+    else
+      statements.push_back(node->getBody());
+    if (f)
+      statements.push_back(f->getStep());
+
+    for (AST* statement : statements)
+    {
+      int64_t step = 0;
+      if (!induction(statement, written, step))
+        continue;
+
+      Assign* a = static_cast<Assign*>(statement);
+      std::vector<Induction*> found;
+      node->setCondition(reduce(node->getCondition(), a->getSlot(), step, written, found));
+      node->setBody(reduce(node->getBody(), a->getSlot(), step, written, found));
+      if (f)
+        f->setStep(reduce(f->getStep(), a->getSlot(), step, written, found));
+      if (found.empty())
+        continue;
+
+      Step* s = new Step(a);
+      for (Induction* i : found)
+      {
+        node->add(i);
+        s->add(i);
+      }
+
+      if (f && f->getStep() == a)
+        f->setStep(s);
+      else if (node->getBody() == a)
+        node->setBody(s);
+      else
+      {
+        Compound* body = static_cast<Compound*>(node->getBody());
+        for (std::vector<AST*>::size_type i = 0; i < body->getChildren().size(); ++i)
+        {
+          if (body->getChildren()[i] == a)
+            body->replace(i, s);
+        }
+      }
+    }
+  }
+
+  // whether a statement is the only assignment in the loop of an `i = i + step`
+  static bool induction(AST* node, const Writes& written, int64_t& step)
+  {
+    if (node->getType() != AST::ASSIGN)
+      return false;
+    Assign* a = static_cast<Assign*>(node);
+    if (written.at(a->getSlot()) != 1 || a->getRight()->getType() != AST::OP_BINARY)
+      return false;
+
+    BinaryOp* b = static_cast<BinaryOp*>(a->getRight());
+    AST* v = b->getLeft();
+    AST* n = b->getRight();
+    if (b->tokenType() == Token::ADDITION && v->getType() == AST::NUMBER)
+      std::swap(v, n);
+    else if (b->tokenType() != Token::ADDITION && b->tokenType() != Token::SUBTRACTION)
+      return false;
+    if (v->getType() != AST::VARIABLE || static_cast<Variable*>(v)->getSlot() != a->getSlot() ||
+        n->getType() != AST::NUMBER || !static_cast<Number*>(n)->getValue().isInt())
+      return false;
+
+    step = static_cast<Number*>(n)->getValue().toInt();
+    if (b->tokenType() == Token::SUBTRACTION)
+    {
+      if (step == std::numeric_limits<int64_t>::min())
+        return false;
+      step = -step;
+    }
+    return true;
+  }
+
+  // replaces the `i * k` in a tree with Inductions
+  AST* reduce(AST* node, const uint32_t slot, const int64_t step, const Writes& written, std::vector<Induction*>& found)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::OP_UNARY:
+      {
+        UnaryOp* u = static_cast<UnaryOp*>(node);
+        u->setNode(reduce(u->getNode(), slot, step, written, found));
+      }
+      break;
+      case AST::Type::OP_BINARY:
+      {
+        BinaryOp* b = static_cast<BinaryOp*>(node);
+        if (b->tokenType() == Token::MULTIPLICATION)
+        {
+          const bool reversed = !isVariable(b->getLeft(), slot);
+          AST* factor = reversed ? b->getLeft() : b->getRight();
+          if (isVariable(reversed ? b->getRight() : b->getLeft(), slot) &&
+              !isVariable(factor, slot) && isConstant(factor, written))
+          {
+            Induction* i = new Induction(static_cast<Variable*>(reversed ? b->getRight() : b->getLeft()), factor, step, reversed);
+            i->setKind(b->getKind());
+            b->setLeft(nullptr);
+            b->setRight(nullptr);
+            delete b;
+            found.push_back(i);
+            return i;
+          }
+        }
+        b->setLeft(reduce(b->getLeft(), slot, step, written, found));
+        b->setRight(reduce(b->getRight(), slot, step, written, found));
+      }
+      break;
+      case AST::Type::OP_POWER:
+      {
+        PowerOp* p = static_cast<PowerOp*>(node);
+        p->setBase(reduce(p->getBase(), slot, step, written, found));
+      }
+      break;
+      case AST::Type::CALL:
+      {
+        Call* c = static_cast<Call*>(node);
+        for (std::vector<AST*>::size_type i = 0; i < c->getArgs().size(); ++i)
+          c->setArg(i, reduce(c->getArgs()[i], slot, step, written, found));
+      }
+      break;
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        for (std::vector<AST*>::size_type i = 0; i < c->getChildren().size(); ++i)
+          c->replace(i, reduce(c->getChildren()[i], slot, step, written, found));
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        a->setRight(reduce(a->getRight(), slot, step, written, found));
+      }
+      break;
+      case AST::Type::FOR:
+      {
+        For* f = static_cast<For*>(node);
+        f->setInit(reduce(f->getInit(), slot, step, written, found));
+        f->setStep(reduce(f->getStep(), slot, step, written, found));
+      }
+      // fall through
+      case AST::Type::WHILE:
+      {
+        Loop* l = static_cast<Loop*>(node);
+        l->setCondition(reduce(l->getCondition(), slot, step, written, found));
+        l->setBody(reduce(l->getBody(), slot, step, written, found));
+      }
+      break;
+      default:
+      break;
+    }
+    return node;
+  }
+
+  static bool isVariable(const AST* node, const uint32_t slot)
+  {
+    return node->getType() == AST::VARIABLE && static_cast<const Variable*>(node)->getSlot() == slot;
+  }
+
+  // leaves that don't change in the loop
+  static bool isConstant(const AST* node, const Writes& written)
+  {
+    if (node->getType() == AST::VARIABLE)
+      return !written.count(static_cast<const Variable*>(node)->getSlot());
+    return node->getType() == AST::NUMBER || node->getType() == AST::HOISTED;
+  }
+
+  static AST* number(const Value& v)
+  {
+    AST* n = new Number(new TokenNumber(v));
+    n->setKind(v.getKind());
+    return n;
+  }
+
+  Options options;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef OUTPUT_H_INCLUDE
+#define OUTPUT_H_INCLUDE
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Scope.h"
+#include "Value.h"
+
+// Writes the variables of a Scope out in one of several formats, buffered
+// and without going through iostreams. Doubles are written with the fewest
+// digits that read back to the same double.
+//
+// TEXT:   `name: value` per line
+// CSV:    a `variable,value` header, then `name,value` per line
+// JSON:   one object of name to value, non-finite doubles are null
+// BINARY: "IVAL", a uint32_t count, then for each variable a uint32_t name
+//         length, the name, a uint8_t Value::Kind and 8 bytes of int64_t or
+//         double, all in host byte order
+class Output
+{
+public:
+  enum Format
+  {
+    TEXT,
+    CSV,
+    JSON,
+    BINARY
+  };
+
+  // names: only write these variables, in this order; all of them in name
+  // order when empty
+  Output(const Format f = TEXT, const std::vector<std::string>& n = std::vector<std::string>(), std::FILE* s = stdout) : format(f), names(n), stream(s) {};
+  ~Output() {};
+
+  inline Format getFormat() const { return format; };
+
+  // the format called `name`, false if there's no such format
+  static bool fromName(const std::string& name, Format& f)
+  {
+    if (name == "text")
+      f = TEXT;
+    else if (name == "csv")
+      f = CSV;
+    else if (name == "json")
+      f = JSON;
+    else if (name == "binary")
+      f = BINARY;
+    else
+      return false;
+    return true;
+  }
+
+  void write(const Scope& scope) const
+  {
+    std::string buffer;
+    buffer.reserve(FLUSH_AT + 256);
+    append(buffer, scope, true);
+    std::fflush(stream);
+  }
+
+  // appends what write would write to buffer instead
+  void write(const Scope& scope, std::string& buffer) const
+  {
+    append(buffer, scope, false);
+  }
+
+  // appends the shortest text that reads back as the same value
+  static void number(std::string& buffer, const Value& v)
+  {
+    char digits[32];
+    std::to_chars_result r;
+    if (v.isInt())
+      r = std::to_chars(digits, digits + sizeof(digits), v.toInt());
+    else
+      r = std::to_chars(digits, digits + sizeof(digits), v.toReal());
+    buffer.append(digits, r.ptr);
+  }
+
+private:
+  static const std::string::size_type FLUSH_AT = 1 << 16;
+
+  // flushing: write to the stream as the buffer fills, and at the end
+  void append(std::string& buffer, const Scope& scope, const bool flushing) const
+  {
+    std::vector<std::pair<const std::string*, Value>> values;
+    if (names.empty())
+    {
+      for (auto&& it : scope.getNames())
+      {
+        const Value v = scope.get(it.second);
+        if (!v.isNone())
+          values.emplace_back(&it.first, v);
+      }
+    }
+    else
+    {
+      for (const std::string& name : names)
+      {
+        const uint32_t slot = scope.find(name);
+        const Value v = slot == Scope::NOT_FOUND ? Value() : scope.get(slot);
+        if (v.isNone())
+          throw std::string("Output: variable has no value: ") + name;
+        values.emplace_back(&name, v);
+      }
+    }
+
+    if (format == CSV)
+      buffer += "variable,value\n";
+    else if (format == JSON)
+      buffer += "{";
+    else if (format == BINARY)
+    {
+      buffer += "IVAL";
+      raw(buffer, static_cast<uint32_t>(values.size()));
+    }
+
+    bool first = true;
+    for (auto&& it : values)
+    {
+      const std::string& name = *it.first;
+      switch (format)
+      {
+        case TEXT:
+          buffer += name;
+          buffer += ": ";
+          number(buffer, it.second);
+          buffer += '\n';
+        break;
+        case CSV:
+          buffer += name;
+          buffer += ',';
+          number(buffer, it.second);
+          buffer += '\n';
+        break;
+        case JSON:
+          if (!first)
+            buffer += ',';
+          buffer += '"';
+          buffer += name;
+          buffer += "\":";
+          if (it.second.isReal() && !std::isfinite(it.second.toReal()))
+            buffer += "null";
+          else
+            number(buffer, it.second);
+        break;
+        case BINARY:
+          raw(buffer, static_cast<uint32_t>(name.length()));
+          buffer += name;
+          buffer += static_cast<char>(it.second.getKind());
+          if (it.second.isInt())
+            raw(buffer, it.second.toInt());
+          else
+            raw(buffer, it.second.toReal());
+        break;
+      }
+      first = false;
+      if (flushing && buffer.length() >= FLUSH_AT)
+        flush(buffer);
+    }
+
+    if (format == JSON)
+      buffer += "}\n";
+    if (flushing)
+      flush(buffer);
+  }
+
+  template <typename T>
+  static void raw(std::string& buffer, const T& v)
+  {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+  }
+
+  void flush(std::string& buffer) const
+  {
+    if (buffer.length() && std::fwrite(buffer.data(), 1, buffer.length(), stream) != buffer.length())
+      throw std::string("Output: failed to write results");
+    buffer.clear();
+  }
+
+  Format format;
+  std::vector<std::string> names;
+  std::FILE* stream;
+};
+
+#endif
@@ -1,41 +1,98 @@
 #ifndef PARSER_H_INCLUDE
 #define PARSER_H_INCLUDE
 
+#include <exception>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "Arena.h"
 #include "Lexer.h"
+#include "Pipeline.h"
 #include "Token.h"
 #include "AST.h"
+#include "Budget.h"
+#include "ThreadPool.h"
 
 class Parser
 {
 public:
-  Parser(Lexer* l) : lexer(l) { token = lexer->nextToken(); };
-  ~Parser() {if (token) delete token; delete lexer; };
+  // threads: how many threads parse the blocks of the top level block,
+  // 1 to parse serially, 0 for one per core
+  // a: the arena to parse into, one of the parser's own if null
+  Parser(Lexer* l, const uint32_t t = 1, Arena* a = nullptr) : lexer(l), pipeline(nullptr), threads(t), arena(a), next(0), ahead(0), depth(0), deepest(0)
+  {
+    start();
+  };
+  // parses tokens from a pipeline, serially
+  Parser(Pipeline* p, Arena* a = nullptr) : lexer(nullptr), pipeline(p), threads(1), arena(a), next(0), ahead(0), depth(0), deepest(0)
+  {
+    start();
+  };
+  ~Parser()
+  {
+    // the arena may be someone else's, and outlive the limit
+    if (memory)
+      arena->setLimit(nullptr);
+    if (token)
+      delete token;
+    for (Block& b : blocks)
+      delete b.tree;
+    delete lexer;
+    delete pipeline;
+  };
+
+  // Limits parsing to the budget's memory and nesting, and to its time,
+  // which starts now. The memory limit is for all of the parser's arenas
+  // together, however many threads parse.
+  void setBudget(const Budget& b)
+  {
+    budget = b;
+    Budget time;
+    time.milliseconds = b.milliseconds;
+    meter.start(time);
+    memory.reset(b.memory ? new Arena::Limit(b.memory) : nullptr);
+    arena->setLimit(memory.get());
+  }
+
+  // how many blocks were parsed ahead of time, and so across threads
+  inline std::vector<AST*>::size_type getParsedAhead() const { return ahead; };
+
+  // the script being parsed, and the file it's from
+  inline const std::string& getText() const { return pipeline ? pipeline->getText() : lexer->getText(); };
+  inline const std::string& getFile() const { return pipeline ? pipeline->getFile() : lexer->getFile(); };
 
   void warning(const std::string& msg)
   {
-    lexer->warning(msg);
+    if (pipeline)
+      pipeline->warning(msg);
+    else
+      lexer->warning(msg);
   }
   void error(const std::string& msg)
   {
-    lexer->error(msg);
+    if (pipeline)
+      pipeline->error(msg);
+    else
+      lexer->error(msg);
   }
 
   void eat(const Token::Type& type)
   {
     if (token->getType() == type)
-      token = lexer->nextToken();
+      token = nextToken();
     else
       error(std::string("expected ") + Token::fromType(type) + " got " + Token::fromType(token->getType()));
   }
 
   // factor : (ADDITION | SUBTRACTION | BITWISE_NOT) factor
   //        | NUMBER
-  //        | PARENTHESIS_L expr PARENTHESIS_R
+  //        | PARENTHESIS_L comparison PARENTHESIS_R
   //        | variable
+  //        | call
   AST* factor()
   {
+    Nest nest(this);
     AST* node = nullptr;
     if (token->getType() & (Token::ADDITION|Token::SUBTRACTION|Token::BITWISE_NOT))
     {
@@ -43,7 +100,7 @@ public:
       eat(token->getType());
       node = new UnaryOp(op, factor());
     }
-    if (token->getType() == Token::NUMBER)
+    else if (token->getType() == Token::NUMBER)
     {
       node = new Number(token);
       eat(Token::NUMBER);
@@ -51,16 +108,45 @@ public:
     else if (token->getType() == Token::PARENTHESIS_L)
     {
       eat(Token::PARENTHESIS_L);
-      node = expr();
+      node = comparison();
       eat(Token::PARENTHESIS_R);
     }
     else
     {
-      node = variable();
+      Variable* v = variable();
+      if (token->getType() == Token::PARENTHESIS_L)
+        node = call(v);
+      else
+        node = v;
     }
     return node;
   }
 
+  // call : ID PARENTHESIS_L (comparison (COMMA comparison)*)? PARENTHESIS_R
+  AST* call(Variable* name)
+  {
+    const Builtin* builtin = Builtins::find(name->getName().c_str());
+    if (!builtin)
+      error(std::string("unknown function: ") + name->getName());
+    delete name;
+
+    std::vector<AST*> args;
+    eat(Token::PARENTHESIS_L);
+    if (token->getType() != Token::PARENTHESIS_R)
+    {
+      args.push_back(comparison());
+      while (token->getType() == Token::COMMA)
+      {
+        eat(Token::COMMA);
+        args.push_back(comparison());
+      }
+    }
+    if (args.size() != builtin->arity)
+      error(std::string("wrong number of arguments to ") + builtin->name);
+    eat(Token::PARENTHESIS_R);
+    return new Call(builtin, args);
+  }
+
   // power : factor (** factor)*
   AST* power()
   {
@@ -107,6 +193,25 @@ public:
     return node;
   }
 
+  // comparison : expr ((LESS | GREATER | LESS_EQUAL | GREATER_EQUAL | EQUAL | NOT_EQUAL) expr)*
+  AST* comparison()
+  {
+    AST* node = expr();
+    const int64_t target = (Token::LESS |
+                      Token::GREATER |
+                      Token::LESS_EQUAL |
+                      Token::GREATER_EQUAL |
+                      Token::EQUAL |
+                      Token::NOT_EQUAL);
+    while (token->getType() & target)
+    {
+      Token* op = token;
+      eat(token->getType());
+      node = new BinaryOp(node, op, expr());
+    }
+    return node;
+  }
+
   Variable* variable()
   {
     Variable* v = new Variable(token);
@@ -119,14 +224,47 @@ public:
     Variable* v = variable();
     Token* t = token;
     eat(Token::ASSIGN);
-    AST* r = expr();
+    AST* r = comparison();
     return new Assign(v, t, r);
   }
 
+  // while_statement : WHILE PARENTHESIS_L comparison PARENTHESIS_R statement
+  AST* while_statement()
+  {
+    eat(Token::WHILE);
+    eat(Token::PARENTHESIS_L);
+    AST* condition = comparison();
+    eat(Token::PARENTHESIS_R);
+    return new While(condition, statement());
+  }
+
+  // for_statement : FOR PARENTHESIS_L assignment_statement SEMICOLON comparison
+  //                 SEMICOLON assignment_statement PARENTHESIS_R statement
+  AST* for_statement()
+  {
+    eat(Token::FOR);
+    eat(Token::PARENTHESIS_L);
+    AST* init = assignment_statement();
+    eat(Token::SEMICOLON);
+    AST* condition = comparison();
+    eat(Token::SEMICOLON);
+    AST* step = assignment_statement();
+    eat(Token::PARENTHESIS_R);
+    return new For(init, condition, step, statement());
+  }
+
   AST* statement()
   {
+    Nest nest(this);
     if (token->getType() == Token::BLOCK_BEGIN)
-      return compound_statement();
+    {
+      AST* block = parsedBlock();
+      return block ? block : compound_statement();
+    }
+    else if (token->getType() == Token::WHILE)
+      return while_statement();
+    else if (token->getType() == Token::FOR)
+      return for_statement();
     else if (token->getType() == Token::ID)
       return assignment_statement();
     if (token->getType() != Token::BLOCK_END)
@@ -134,12 +272,20 @@ public:
     return new NoOp();
   }
 
+  // statements ending in a block don't need a semicolon after them
+  static bool endsInBlock(const AST* node)
+  {
+    while (node->getType() == AST::WHILE || node->getType() == AST::FOR)
+      node = static_cast<const Loop*>(node)->getBody();
+    return node->getType() == AST::COMPOUND;
+  }
+
   void statement_list(std::vector<AST*>& statements)
   {
     statements.push_back(statement());
-    while (statements.back()->getType() == AST::COMPOUND || token->getType() == Token::SEMICOLON)
+    while (endsInBlock(statements.back()) || token->getType() == Token::SEMICOLON)
     {
-      if (statements.back()->getType() != AST::COMPOUND)
+      if (!endsInBlock(statements.back()))
         eat(Token::SEMICOLON);
       statements.push_back(statement());
     }
@@ -163,8 +309,12 @@ public:
     return compound_statement();
   }
 
+  // the tree lives in the parser's arenas, so must be deleted before it is
   AST* parse()
   {
+    Arena::Use use(arena);
+    if (threads != 1)
+      parseBlocks();
     AST* node = program();
     if (token->getType() != Token::END_OF_FILE)
       error("unexpected end of input");
@@ -172,8 +322,155 @@ public:
   }
 
 private:
+  void start()
+  {
+    if (!arena)
+    {
+      arenas.emplace_back(new Arena());
+      arena = arenas.front().get();
+    }
+    Arena::Use use(arena);
+    token = nextToken();
+  }
+
+  inline Token* nextToken()
+  {
+    meter.charge(1);
+    return pipeline ? pipeline->nextToken() : lexer->nextToken();
+  };
+
+  // how deeply the parser has recursed, against the budget's nesting
+  class Nest
+  {
+  public:
+    Nest(Parser* p) : parser(p)
+    {
+      if (++parser->depth > parser->budget.nesting && parser->budget.nesting)
+      {
+        --parser->depth;
+        throw Budget::Exceeded(Budget::Exceeded::NESTING, parser->budget.nesting);
+      }
+      if (parser->depth > parser->deepest)
+        parser->deepest = parser->depth;
+    };
+    ~Nest() { --parser->depth; };
+
+  private:
+    Parser* parser;
+  };
+
+  // a block parsed ahead of time
+  struct Block
+  {
+    Lexer::Span span;
+    AST* tree;
+    std::exception_ptr error; // what parsing it threw
+    uint32_t deepest; // how far it nested, from 1 for the statement it's in
+  };
+
+  // Parses the blocks within the top level block across threads, each into
+  // its own arena, for statement to pick up as it reaches them.
+  void parseBlocks()
+  {
+    // the top level block's { is the token already read
+    for (const Lexer::Span& span : lexer->blocks(token->getType() == Token::BLOCK_BEGIN ? 1 : 0))
+      blocks.push_back(Block{span, nullptr, nullptr, 0});
+    if (blocks.size() < 2)
+      return;
+
+    // share the blocks out by size
+    ThreadPool pool(ThreadPool::threads(threads));
+    std::string::size_type total = 0;
+    for (const Block& b : blocks)
+      total += b.span.end.pos - b.span.begin.pos;
+    const std::string::size_type share = total / pool.size() + 1;
+
+    std::vector<Block>::size_type first = 0;
+    std::string::size_type size = 0;
+    for (std::vector<Block>::size_type i = 0; i < blocks.size(); ++i)
+    {
+      size += blocks[i].span.end.pos - blocks[i].span.begin.pos;
+      if (size >= share || i + 1 == blocks.size())
+      {
+        arenas.emplace_back(new Arena());
+        Arena* blockArena = arenas.back().get();
+        blockArena->setLimit(memory.get());
+        pool.submit([this, first, i, blockArena]() { parseBlocks(first, i + 1, blockArena); });
+        first = i + 1;
+        size = 0;
+      }
+    }
+    pool.wait();
+  }
+
+  void parseBlocks(const std::vector<Block>::size_type first, const std::vector<Block>::size_type last, Arena* blockArena)
+  {
+    Arena::Use use(blockArena);
+    for (std::vector<Block>::size_type i = first; i < last; ++i)
+    {
+      Block& b = blocks[i];
+      try
+      {
+        Parser parser(new Lexer(*lexer, b.span.begin, b.span.end.pos), 1, blockArena);
+        parser.budget = budget;
+        parser.meter = meter; // with the same deadline
+        // the least depth statement could reach it at, the real one being
+        // checked against how deep it went once it's reached
+        parser.depth = 1;
+        AST* tree = parser.compound_statement();
+        b.deepest = parser.deepest;
+        // didn't end where expected, let the serial parse deal with it
+        if (parser.token->getType() != Token::END_OF_FILE)
+          delete tree;
+        else
+          b.tree = tree;
+      }
+      catch (...)
+      {
+        b.error = std::current_exception();
+      }
+    }
+  }
+
+  // the tree of the block starting at the current token, if it was parsed
+  // ahead of time
+  AST* parsedBlock()
+  {
+    while (next < blocks.size() && blocks[next].span.begin.pos < lexer->tokenStart())
+      ++next;
+    if (next == blocks.size() || blocks[next].span.begin.pos != lexer->tokenStart())
+      return nullptr;
+
+    Block& b = blocks[next++];
+    if (b.error)
+      std::rethrow_exception(b.error);
+    if (budget.nesting && depth - 1 + b.deepest > budget.nesting)
+      throw Budget::Exceeded(Budget::Exceeded::NESTING, budget.nesting);
+    AST* tree = b.tree;
+    if (!tree)
+      return nullptr;
+    b.tree = nullptr;
+    ++ahead;
+    lexer->seek(b.span.end);
+    delete token;
+    token = nextToken();
+    return tree;
+  }
+
   Lexer* lexer;
+  Pipeline* pipeline; // where the tokens come from instead, if not null
   Token* token;
+  uint32_t threads;
+  Arena* arena; // the one the tree is parsed into
+  std::vector<std::unique_ptr<Arena>> arenas;
+  std::vector<Block> blocks;
+  std::vector<Block>::size_type next;
+  std::vector<AST*>::size_type ahead;
+  Budget budget;
+  Budget::Meter meter; // charged a token at a time
+  std::unique_ptr<Arena::Limit> memory; // shared by all the arenas, if limited
+  uint32_t depth;
+  uint32_t deepest;
 };
 
 #endif
@@ -0,0 +1,243 @@
+#ifndef PIPELINE_H_INCLUDE
+#define PIPELINE_H_INCLUDE
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Arena.h"
+#include "Lexer.h"
+#include "RingBuffer.h"
+#include "Token.h"
+
+// Reads, lexes and hands tokens to a parser all at once, on three threads.
+// A reader thread reads the file into a buffer the size of the whole file,
+// saying how much is there as it goes, and a lexer thread lexes it as it
+// arrives into blocks of tokens passed to the parser through a ring buffer,
+// which passes them back through another once used. The tokens are
+// allocated from an arena of the pipeline's, so it must outlive any tree
+// parsed from them.
+//
+// Each token comes with where the lexer was after lexing it, which is where
+// a serial lexer would be while the parser looks at it, so errors and
+// warnings read the same as they would without a pipeline.
+class Pipeline : private Lexer::Stream
+{
+public:
+  Pipeline(const std::string& f) : file(f), size(0), read(0), finished(false), stopping(false), current(nullptr), index(0), ended(false), at(Lexer::Position{0, 1, 1})
+  {
+    std::ifstream* in = new std::ifstream(file.c_str(), std::ios::binary | std::ios::ate);
+    if (!in->is_open() || !in->good())
+    {
+      delete in;
+      throw std::string("failed to read script");
+    }
+    size = static_cast<std::string::size_type>(in->tellg());
+    in->seekg(0);
+    text = std::make_shared<std::string>(size, '\0');
+
+    for (Block& b : blocks)
+      empty.push(&b);
+    reader = std::thread([this, in]() { readText(in); });
+    try
+    {
+      lexer.reset(new Lexer(text, file, this));
+    }
+    catch (...)
+    {
+      stopping.store(true, std::memory_order_relaxed);
+      reader.join();
+      throw;
+    }
+    lexing = std::thread([this]() { lex(); });
+  };
+  ~Pipeline()
+  {
+    stopping.store(true, std::memory_order_relaxed);
+    lexing.join();
+    reader.join();
+
+    // the tokens the parser never got
+    if (current)
+    {
+      for (uint32_t i = index; i < current->count; ++i)
+        delete current->tokens[i].token;
+    }
+    Block* b;
+    while (full.pop(b))
+    {
+      for (uint32_t i = 0; i < b->count; ++i)
+        delete b->tokens[i].token;
+    }
+  };
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  // the next token, as Lexer::nextToken; only ever called by one thread
+  Token* nextToken()
+  {
+    if (ended)
+      return new TokenEOF();
+    while (!current || index == current->count)
+    {
+      if (current)
+      {
+        if (current->error.length())
+          throw current->error;
+        empty.push(current);
+        current = nullptr;
+      }
+      while (!full.pop(current))
+        std::this_thread::yield();
+      index = 0;
+    }
+    const Lexed& l = current->tokens[index++];
+    at = l.after;
+    ended = l.token->getType() == Token::END_OF_FILE;
+    return l.token;
+  }
+
+  inline const std::string& getText() const { return lexer->getText(); };
+  inline const std::string& getFile() const { return file; };
+
+  void warning(const std::string& msg)
+  {
+    std::cout << lexer->report(at, "warning", msg);
+  }
+  void error(const std::string& msg)
+  {
+    throw lexer->report(at, "error", msg);
+  }
+
+private:
+  static const std::string::size_type CHUNK = 1 << 16; // bytes read at a time
+  static const uint32_t BLOCK = 256; // tokens per block
+  static const std::size_t BLOCKS = 16;
+
+  struct Lexed
+  {
+    Token* token;
+    Lexer::Position after;
+  };
+
+  struct Block
+  {
+    Lexed tokens[BLOCK];
+    uint32_t count;
+    std::string error; // what stopped the lexer after the tokens
+  };
+
+  void readText(std::ifstream* in)
+  {
+    std::string::size_type done = 0;
+    while (done < size && !stopping.load(std::memory_order_relaxed))
+    {
+      const std::string::size_type n = size - done < CHUNK ? size - done : CHUNK;
+      in->read(&(*text)[done], static_cast<std::streamsize>(n));
+      const std::string::size_type got = static_cast<std::string::size_type>(in->gcount());
+      if (got == 0)
+      {
+        failure = "failed to read script";
+        break;
+      }
+      done += got;
+      read.store(done, std::memory_order_release);
+    }
+    delete in;
+    finished.store(true, std::memory_order_release);
+  }
+
+  // Lexer::Stream
+  virtual std::string::size_type more(const std::string::size_type have)
+  {
+    std::string::size_type n;
+    while ((n = read.load(std::memory_order_acquire)) <= have && !finished.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    if (n <= have)
+    {
+      n = read.load(std::memory_order_acquire);
+      if (failure.length())
+        throw failure;
+    }
+    return n;
+  }
+  virtual std::string::size_type all()
+  {
+    while (!finished.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    if (failure.length())
+      throw failure;
+    return read.load(std::memory_order_acquire);
+  }
+
+  void lex()
+  {
+    Arena::Use use(&arena);
+    for (;;)
+    {
+      Block* b;
+      while (!empty.pop(b))
+      {
+        if (stopping.load(std::memory_order_relaxed))
+          return;
+        std::this_thread::yield();
+      }
+
+      b->count = 0;
+      b->error.clear();
+      bool last = false;
+      try
+      {
+        while (b->count < BLOCK && !last)
+        {
+          Token* t = lexer->nextToken();
+          b->tokens[b->count++] = Lexed{t, lexer->here()};
+          last = t->getType() == Token::END_OF_FILE;
+        }
+      }
+      catch (std::string e)
+      {
+        b->error = e;
+        last = true;
+      }
+      catch (std::exception& e)
+      {
+        b->error = e.what();
+        last = true;
+      }
+      full.push(b); // there's room for every block
+      if (last || stopping.load(std::memory_order_relaxed))
+        return;
+    }
+  }
+
+  std::string file;
+  std::shared_ptr<std::string> text;
+  std::string::size_type size;
+  std::atomic<std::string::size_type> read; // how much of text has been read
+  std::atomic<bool> finished; // reading has stopped
+  std::string failure; // why, if it failed, written before finished is set
+  std::atomic<bool> stopping;
+
+  Arena arena; // the lexer thread's
+  std::unique_ptr<Lexer> lexer;
+  Block blocks[BLOCKS];
+  RingBuffer<Block*, BLOCKS> full; // lexer to parser
+  RingBuffer<Block*, BLOCKS> empty; // and back
+
+  // the parser's side
+  Block* current;
+  uint32_t index;
+  bool ended;
+  Lexer::Position at;
+
+  std::thread reader;
+  std::thread lexing;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef PUBLISHED_H_INCLUDE
+#define PUBLISHED_H_INCLUDE
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Scope.h"
+#include "Value.h"
+
+// A copy of the variables of a program that any number of threads can read
+// while it runs, without locks and without holding up the thread writing.
+// Each slot is guarded by a sequence number that's odd while it's being
+// written: a reader reads the number, the value and the number again, and
+// tries again if it was odd or changed, so it never sees half of a write.
+// Writing costs two stores more than writing the Scope does.
+//
+// Each slot must only be written by one thread at a time, which is the case
+// for a program's statements, parallel or not. Every value read is one the
+// variable really had, but reading several is not one consistent view of
+// them all.
+class Published
+{
+public:
+  // with the variables and values of a scope
+  Published(const Scope& scope) : names(scope.getNames()), count(scope.size()), slots(new Slot[scope.size()])
+  {
+    for (uint32_t slot = 0; slot < count; ++slot)
+      set(slot, scope.get(slot));
+  };
+  ~Published() {};
+
+  Published(const Published&) = delete;
+  Published& operator=(const Published&) = delete;
+
+  // writer only
+  inline void set(const uint32_t slot, const Value& v)
+  {
+    Slot& s = slots[slot];
+    uint64_t bits;
+    if (v.isReal())
+    {
+      const double d = v.toReal();
+      std::memcpy(&bits, &d, sizeof(bits));
+    }
+    else
+      bits = static_cast<uint64_t>(v.isInt() ? v.toInt() : 0);
+
+    const uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+    s.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // odd before the value
+    s.kind.store(static_cast<uint8_t>(v.getKind()), std::memory_order_relaxed);
+    s.bits.store(bits, std::memory_order_relaxed);
+    s.sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // any thread
+  Value get(const uint32_t slot) const
+  {
+    const Slot& s = slots[slot];
+    for (;;)
+    {
+      const uint32_t before = s.sequence.load(std::memory_order_acquire);
+      if (before & 1)
+      {
+        std::this_thread::yield(); // the writer may not be running
+        continue;
+      }
+      const uint8_t kind = s.kind.load(std::memory_order_relaxed);
+      const uint64_t bits = s.bits.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire); // the value before the number
+      if (s.sequence.load(std::memory_order_relaxed) != before)
+        continue;
+
+      switch (kind)
+      {
+        case Value::Kind::INT:
+          return Value(static_cast<int64_t>(bits));
+        case Value::Kind::REAL:
+        {
+          double d;
+          std::memcpy(&d, &bits, sizeof(d));
+          return Value(d);
+        }
+        default:
+          return Value();
+      }
+    }
+  }
+
+  // a variable's value, NONE if there's no such variable or it has no value
+  Value get(const std::string& name) const
+  {
+    const uint32_t slot = find(name);
+    return slot == Scope::NOT_FOUND ? Value() : get(slot);
+  }
+
+  // the slot for a name, or Scope::NOT_FOUND
+  uint32_t find(const std::string& name) const
+  {
+    auto it = names.find(name);
+    return it == std::end(names) ? Scope::NOT_FOUND : it->second;
+  }
+
+  inline uint32_t size() const { return count; };
+
+  // names and their slots, in name order, which never change
+  inline const std::map<std::string, uint32_t>& getNames() const { return names; };
+
+private:
+  struct Slot
+  {
+    Slot() : sequence(0), kind(Value::Kind::NONE), bits(0) {};
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint8_t> kind;
+    std::atomic<uint64_t> bits; // the int64_t or double
+  };
+
+  const std::map<std::string, uint32_t> names;
+  const uint32_t count;
+  std::unique_ptr<Slot[]> slots;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef RINGBUFFER_H_INCLUDE
+#define RINGBUFFER_H_INCLUDE
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed size queue between exactly one producing thread and one consuming
+// thread, without locks. Neither side waits: push fails when it's full and
+// pop when it's empty. N must be a power of two.
+template <typename T, std::size_t N>
+class RingBuffer
+{
+  static_assert(N && (N & (N - 1)) == 0, "RingBuffer: size must be a power of two");
+
+public:
+  RingBuffer() : head(0), tail(0) {};
+  ~RingBuffer() {};
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  // producer only
+  bool push(const T& item)
+  {
+    const std::size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N)
+      return false;
+    items[t & (N - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only
+  bool pop(T& item)
+  {
+    const std::size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    item = items[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  // on their own cache lines, so each side only writes to its own
+  alignas(64) std::atomic<std::size_t> head; // next to pop
+  alignas(64) std::atomic<std::size_t> tail; // next to push
+  alignas(64) T items[N];
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef SCHEDULE_H_INCLUDE
+#define SCHEDULE_H_INCLUDE
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "AST.h"
+
+// The statements of a Compound grouped into levels, such that statements in
+// the same level don't touch each other's variables and every statement
+// comes after the ones it depends on: the ones writing what it reads (or
+// writes), and the ones reading what it writes. Running the levels in order,
+// each in any order, gives the same result as running the statements in
+// order. Variables are identified by their slot, so the tree has to have
+// been resolved.
+class Schedule
+{
+public:
+  Schedule(Compound* node)
+  {
+    std::map<uint32_t, uint32_t> lastWrite;
+    std::map<uint32_t, uint32_t> lastRead;
+    std::set<uint32_t> written;
+
+    const std::vector<AST*>& children = node->getChildren();
+    for (std::vector<AST*>::size_type i = 0; i < children.size(); ++i)
+    {
+      std::set<uint32_t> reads;
+      std::set<uint32_t> writes;
+      collect(children[i], reads, writes, written);
+      first.push_back(changed.size());
+      changed.insert(std::end(changed), std::begin(writes), std::end(writes));
+
+      uint32_t level = 0;
+      for (const uint32_t v : reads)
+        level = std::max(level, after(lastWrite, v));
+      for (const uint32_t v : writes)
+        level = std::max(level, std::max(after(lastWrite, v), after(lastRead, v)));
+
+      for (const uint32_t v : reads)
+        lastRead[v] = std::max(lastRead[v], level + 1);
+      for (const uint32_t v : writes)
+        lastWrite[v] = level + 1;
+
+      if (level == levels.size())
+        levels.emplace_back();
+      levels[level].push_back(i);
+    }
+    first.push_back(changed.size());
+  };
+  ~Schedule() {};
+
+  // indices of the statements in each level, in statement order
+  inline const std::vector<std::vector<std::vector<AST*>::size_type>>& getLevels() const { return levels; };
+  // variables read before the compound assigns them, which have to exist
+  // beforehand
+  inline const std::vector<uint32_t>& getInputs() const { return inputs; };
+  // the variables each statement writes, those of statement i being from
+  // getFirst()[i] up to getFirst()[i + 1]
+  inline const std::vector<uint32_t>& getWrites() const { return changed; };
+  inline const std::vector<std::vector<uint32_t>::size_type>& getFirst() const { return first; };
+  // whether any two statements can run at once
+  inline bool isParallel() const { return levels.size() < statements(); };
+
+private:
+  static uint32_t after(const std::map<uint32_t, uint32_t>& last, const uint32_t v)
+  {
+    auto it = last.find(v);
+    return it == std::end(last) ? 0 : it->second;
+  }
+
+  std::vector<AST*>::size_type statements() const
+  {
+    std::vector<AST*>::size_type n = 0;
+    for (auto&& level : levels)
+      n += level.size();
+    return n;
+  }
+
+  // gathers what a statement reads and writes, noting reads of variables not
+  // yet written as inputs
+  void collect(AST* node, std::set<uint32_t>& reads, std::set<uint32_t>& writes, std::set<uint32_t>& written)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::NO_OP:
+      case AST::Type::NUMBER:
+      break;
+      case AST::Type::OP_UNARY:
+        collect(static_cast<UnaryOp*>(node)->getNode(), reads, writes, written);
+      break;
+      case AST::Type::OP_BINARY:
+        collect(static_cast<BinaryOp*>(node)->getLeft(), reads, writes, written);
+        collect(static_cast<BinaryOp*>(node)->getRight(), reads, writes, written);
+      break;
+      case AST::Type::VARIABLE:
+        read(static_cast<Variable*>(node)->getSlot(), reads, written);
+      break;
+      case AST::Type::COMPOUND:
+      {
+        // entering a block empties its frame
+        Compound* c = static_cast<Compound*>(node);
+        for (uint32_t slot = c->getFrame(); slot < c->getFrame() + c->getFrameSize(); ++slot)
+        {
+          writes.insert(slot);
+          written.insert(slot);
+        }
+        for (AST* child : c->getChildren())
+          collect(child, reads, writes, written);
+      }
+      break;
+      case AST::Type::ASSIGN:
+      {
+        Assign* a = static_cast<Assign*>(node);
+        collect(a->getRight(), reads, writes, written);
+        writes.insert(a->getSlot());
+        written.insert(a->getSlot());
+      }
+      break;
+      case AST::Type::OP_POWER:
+        collect(static_cast<PowerOp*>(node)->getBase(), reads, writes, written);
+      break;
+      case AST::Type::OP_VAR_CONST:
+        read(static_cast<VarConstOp*>(node)->getVariable()->getSlot(), reads, written);
+      break;
+      case AST::Type::OP_VAR_VAR:
+        read(static_cast<VarVarOp*>(node)->getLeft()->getSlot(), reads, written);
+        read(static_cast<VarVarOp*>(node)->getRight()->getSlot(), reads, written);
+      break;
+      case AST::Type::OP_MUL_ADD:
+        collect(static_cast<MulAddOp*>(node)->getMultiplier(), reads, writes, written);
+        collect(static_cast<MulAddOp*>(node)->getMultiplicand(), reads, writes, written);
+        collect(static_cast<MulAddOp*>(node)->getAddend(), reads, writes, written);
+      break;
+      case AST::Type::CALL:
+        for (AST* a : static_cast<Call*>(node)->getArgs())
+          collect(a, reads, writes, written);
+      break;
+      case AST::Type::FOR:
+        collect(static_cast<For*>(node)->getInit(), reads, writes, written);
+        collect(static_cast<Loop*>(node)->getCondition(), reads, writes, written);
+        collect(static_cast<Loop*>(node)->getBody(), reads, writes, written);
+        collect(static_cast<For*>(node)->getStep(), reads, writes, written);
+      break;
+      case AST::Type::WHILE:
+        collect(static_cast<Loop*>(node)->getCondition(), reads, writes, written);
+        collect(static_cast<Loop*>(node)->getBody(), reads, writes, written);
+      break;
+      case AST::Type::HOISTED:
+        collect(static_cast<Hoisted*>(node)->getNode(), reads, writes, written);
+      break;
+      case AST::Type::INDUCTION:
+        collect(static_cast<Induction*>(node)->getVariable(), reads, writes, written);
+        collect(static_cast<Induction*>(node)->getFactor(), reads, writes, written);
+      break;
+      case AST::Type::STEP:
+        collect(static_cast<Step*>(node)->getAssign(), reads, writes, written);
+      break;
+    }
+  }
+
+  void read(const uint32_t slot, std::set<uint32_t>& reads, const std::set<uint32_t>& written)
+  {
+    reads.insert(slot);
+    if (!written.count(slot) && !knownInputs.count(slot))
+    {
+      knownInputs.insert(slot);
+      inputs.push_back(slot);
+    }
+  }
+
+  std::vector<std::vector<std::vector<AST*>::size_type>> levels;
+  std::vector<uint32_t> inputs;
+  std::vector<uint32_t> changed;
+  std::vector<std::vector<uint32_t>::size_type> first;
+  std::set<uint32_t> knownInputs;
+};
+
+#endif
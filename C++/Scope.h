@@ -0,0 +1,362 @@
+#ifndef SCOPE_H_INCLUDE
+#define SCOPE_H_INCLUDE
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AST.h"
+#include "Value.h"
+
+// The variables of a program. Every variable is resolved to a slot once,
+// when the program is compiled, so evaluating never looks a name up.
+// A slot can be bound to a double owned by the host, in which case reads and
+// writes go straight to it.
+//
+// Slots are kept in fixed size chunks. Copying a Scope shares the chunks and
+// names, and whichever copy writes to a shared chunk first gets a chunk of
+// its own, so a copy costs a pointer per chunk and copies are independent.
+// A copy takes the values of bound slots but not the bindings. Different
+// copies can be used on different threads.
+class Scope
+{
+public:
+  Scope() : names(std::make_shared<Names>()), count(0), bindings(0) {};
+  Scope(const Scope& s) : names(s.names), chunks(s.chunks), count(s.count), bindings(0)
+  {
+    for (Chunk* c : chunks)
+      c->refs.fetch_add(1, std::memory_order_relaxed);
+    if (s.bindings)
+    {
+      for (uint32_t slot = 0; slot < count; ++slot)
+      {
+        if (s.slotAt(slot).bound)
+        {
+          Slot& mine = own(slot);
+          mine.value = Value(*mine.bound);
+          mine.bound = nullptr;
+        }
+      }
+    }
+  };
+  Scope& operator=(Scope s)
+  {
+    std::swap(names, s.names);
+    std::swap(chunks, s.chunks);
+    std::swap(count, s.count);
+    std::swap(bindings, s.bindings);
+    return *this;
+  }
+  ~Scope()
+  {
+    for (Chunk* c : chunks)
+      release(c);
+  };
+
+  // the slot for a name, creating it if it's new
+  uint32_t declare(const std::string& name)
+  {
+    auto it = names->find(name);
+    if (it != std::end(*names))
+      return it->second;
+    if (names.use_count() != 1)
+      names = std::make_shared<Names>(*names);
+    else
+      std::atomic_thread_fence(std::memory_order_acquire); // after other copies' last reads
+    const uint32_t slot = count++;
+    names->emplace(name, slot);
+    // the rest of the last chunk is never written until it's declared, so
+    // it's empty even when it's shared
+    if ((slot & MASK) == 0)
+      chunks.push_back(new Chunk());
+    return slot;
+  }
+
+  // the slot for a name, or NOT_FOUND
+  uint32_t find(const std::string& name) const
+  {
+    auto it = names->find(name);
+    return it == std::end(*names) ? NOT_FOUND : it->second;
+  }
+
+  inline Value get(const uint32_t slot) const
+  {
+    const Slot& s = slotAt(slot);
+    return s.bound ? Value(*s.bound) : s.value;
+  }
+
+  inline void set(const uint32_t slot, const Value& v)
+  {
+    Slot& s = own(slot);
+    if (s.bound)
+      *s.bound = v.toReal();
+    else
+      s.value = v;
+  }
+
+  // reads and writes of the slot use *location from now on, nullptr to unbind
+  void bind(const uint32_t slot, double* location)
+  {
+    Slot& s = own(slot);
+    if (!location && s.bound)
+      s.value = Value(*s.bound);
+    if (location && !s.bound)
+      ++bindings;
+    else if (!location && s.bound)
+      --bindings;
+    s.bound = location;
+  }
+
+  // gives the scope a copy of its own of every chunk it shares, so different
+  // slots can be set from different threads at once
+  void unshare()
+  {
+    for (uint32_t slot = 0; slot < count; slot += MASK + 1)
+      own(slot);
+  }
+
+  inline uint32_t size() const { return count; };
+
+  // names and their slots, in name order
+  inline const std::map<std::string, uint32_t>& getNames() const { return *names; };
+
+  // Gives every variable in a tree its slot. The tree's own block is the
+  // global scope. With blocks, a variable first assigned in a block inside
+  // it belongs to that block and to the blocks inside that, and lives in the
+  // block's frame. Blocks don't recurse, so each frame's place on the stack
+  // is fixed here: after the frames of the blocks around it, and in the
+  // same slots as the frames of blocks beside it, which it never overlaps
+  // in time when running in order. Statements run at once need frames of
+  // their own, so unless shared every frame gets its own slots. The stack is
+  // slots after the globals without names, so it's never output. Without
+  // blocks, every variable is global.
+  void resolve(AST* node, const bool blocks = true, const bool shared = true)
+  {
+    Frames frames;
+    frames.blocks = blocks;
+    if (node->getType() == AST::COMPOUND)
+    {
+      for (AST* child : static_cast<Compound*>(node)->getChildren())
+        resolve(child, frames);
+    }
+    else
+      resolve(node, frames);
+    if (frames.all.empty())
+      return;
+
+    const uint32_t base = count;
+    uint32_t depth = 0;
+    for (Frame& f : frames.all)
+    {
+      if (!shared)
+        f.base = depth;
+      else if (f.parent != NO_FRAME)
+        f.base = frames.all[f.parent].base + frames.all[f.parent].names.size();
+      f.block->setFrame(base + f.base, f.names.size());
+      depth = std::max<uint32_t>(depth, f.base + f.names.size());
+    }
+    for (auto&& local : frames.locals)
+      local.first->setSlot(base + frames.all[local.second.first].base + local.second.second);
+
+    for (uint32_t i = 0; i < depth; ++i)
+    {
+      if ((count++ & MASK) == 0)
+        chunks.push_back(new Chunk());
+    }
+  }
+
+  // empties n slots from first, as entering a block does its frame
+  void clear(const uint32_t first, const uint32_t n)
+  {
+    for (uint32_t slot = first; slot < first + n; ++slot)
+      own(slot).value = Value();
+  }
+
+  static const uint32_t NOT_FOUND = UINT32_MAX;
+
+private:
+  typedef std::map<std::string, uint32_t> Names;
+
+  static const uint32_t NO_FRAME = UINT32_MAX;
+
+  // a block's variables while resolving
+  struct Frame
+  {
+    Compound* block;
+    uint32_t parent; // the frame of the block around it, or NO_FRAME
+    uint32_t base; // where it starts on the stack
+    Names names; // and where each variable is in it
+  };
+
+  struct Frames
+  {
+    bool blocks;
+    std::vector<Frame> all; // in the order the blocks start
+    std::vector<uint32_t> open; // those of the blocks being resolved
+    // each local variable, with its frame and where it is in that
+    std::vector<std::pair<Variable*, std::pair<uint32_t, uint32_t>>> locals;
+  };
+
+  void resolve(AST* node, Frames& frames)
+  {
+    switch (node->getType())
+    {
+      case AST::Type::NO_OP:
+      case AST::Type::NUMBER:
+      break;
+      case AST::Type::OP_UNARY:
+        resolve(static_cast<UnaryOp*>(node)->getNode(), frames);
+      break;
+      case AST::Type::OP_BINARY:
+        resolve(static_cast<BinaryOp*>(node)->getLeft(), frames);
+        resolve(static_cast<BinaryOp*>(node)->getRight(), frames);
+      break;
+      case AST::Type::VARIABLE:
+        variable(static_cast<Variable*>(node), frames, false);
+      break;
+      case AST::Type::COMPOUND:
+      {
+        Compound* c = static_cast<Compound*>(node);
+        if (frames.blocks)
+        {
+          const uint32_t parent = frames.open.empty() ? NO_FRAME : frames.open.back();
+          frames.open.push_back(frames.all.size());
+          frames.all.push_back(Frame{c, parent, 0, Names()});
+        }
+        for (AST* child : c->getChildren())
+          resolve(child, frames);
+        if (frames.blocks)
+          frames.open.pop_back();
+      }
+      break;
+      case AST::Type::ASSIGN:
+        resolve(static_cast<Assign*>(node)->getRight(), frames);
+        variable(static_cast<Assign*>(node)->getVariable(), frames, true);
+      break;
+      case AST::Type::OP_POWER:
+        resolve(static_cast<PowerOp*>(node)->getBase(), frames);
+      break;
+      case AST::Type::OP_VAR_CONST:
+        resolve(static_cast<VarConstOp*>(node)->getVariable(), frames);
+      break;
+      case AST::Type::OP_VAR_VAR:
+        resolve(static_cast<VarVarOp*>(node)->getLeft(), frames);
+        resolve(static_cast<VarVarOp*>(node)->getRight(), frames);
+      break;
+      case AST::Type::OP_MUL_ADD:
+        resolve(static_cast<MulAddOp*>(node)->getMultiplier(), frames);
+        resolve(static_cast<MulAddOp*>(node)->getMultiplicand(), frames);
+        resolve(static_cast<MulAddOp*>(node)->getAddend(), frames);
+      break;
+      case AST::Type::CALL:
+        for (AST* a : static_cast<Call*>(node)->getArgs())
+          resolve(a, frames);
+      break;
+      case AST::Type::FOR:
+        resolve(static_cast<For*>(node)->getInit(), frames);
+        resolve(static_cast<Loop*>(node)->getCondition(), frames);
+        resolve(static_cast<Loop*>(node)->getBody(), frames);
+        resolve(static_cast<For*>(node)->getStep(), frames);
+      break;
+      case AST::Type::WHILE:
+        resolve(static_cast<Loop*>(node)->getCondition(), frames);
+        resolve(static_cast<Loop*>(node)->getBody(), frames);
+      break;
+      case AST::Type::HOISTED:
+        resolve(static_cast<Hoisted*>(node)->getNode(), frames);
+      break;
+      case AST::Type::INDUCTION:
+        resolve(static_cast<Induction*>(node)->getVariable(), frames);
+        resolve(static_cast<Induction*>(node)->getFactor(), frames);
+      break;
+      case AST::Type::STEP:
+        resolve(static_cast<Step*>(node)->getAssign(), frames);
+      break;
+    }
+  }
+
+  // The innermost variable of the name in the blocks being resolved, or
+  // else the global one. Assigning a name that's neither makes it local to
+  // the innermost block; reading one makes it global, as it may be an input.
+  void variable(Variable* v, Frames& frames, const bool assigned)
+  {
+    for (auto f = frames.open.rbegin(); f != frames.open.rend(); ++f)
+    {
+      const Names& names = frames.all[*f].names;
+      auto it = names.find(v->getName());
+      if (it != std::end(names))
+      {
+        frames.locals.emplace_back(v, std::make_pair(*f, it->second));
+        return;
+      }
+    }
+    if (assigned && !frames.open.empty() && find(v->getName()) == NOT_FOUND)
+    {
+      Names& names = frames.all[frames.open.back()].names;
+      const uint32_t index = names.size();
+      names.emplace(v->getName(), index);
+      frames.locals.emplace_back(v, std::make_pair(frames.open.back(), index));
+      return;
+    }
+    v->setSlot(declare(v->getName()));
+  }
+
+  static const uint32_t SHIFT = 6;
+  static const uint32_t MASK = (1 << SHIFT) - 1;
+
+  struct Slot
+  {
+    Value value;
+    double* bound = nullptr;
+  };
+
+  struct Chunk
+  {
+    Chunk() : refs(1) {};
+    Chunk(const Chunk& c) : refs(1)
+    {
+      for (uint32_t i = 0; i <= MASK; ++i)
+        slots[i] = c.slots[i];
+    };
+
+    std::atomic<uint32_t> refs; // how many scopes share it
+    Slot slots[MASK + 1];
+  };
+
+  inline const Slot& slotAt(const uint32_t slot) const
+  {
+    return chunks[slot >> SHIFT]->slots[slot & MASK];
+  }
+
+  // the slot, in a chunk of this scope's own
+  inline Slot& own(const uint32_t slot)
+  {
+    Chunk*& c = chunks[slot >> SHIFT];
+    // acquire, so other copies are done reading it once it's ours alone
+    if (c->refs.load(std::memory_order_acquire) != 1)
+    {
+      Chunk* copy = new Chunk(*c);
+      release(c);
+      c = copy;
+    }
+    return c->slots[slot & MASK];
+  }
+
+  static void release(Chunk* c)
+  {
+    if (c->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete c;
+  }
+
+  std::shared_ptr<Names> names; // shared with copies until declaring
+  std::vector<Chunk*> chunks;
+  uint32_t count; // slots
+  uint32_t bindings; // slots bound to a double
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef SNAPSHOT_H_INCLUDE
+#define SNAPSHOT_H_INCLUDE
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Scope.h"
+#include "Value.h"
+
+// The variables of an interpreter at some point, and optionally the script
+// it was running. Taking one, restoring one into an interpreter that hasn't
+// compiled anything yet and copying one all share the variables' memory
+// until something writes to them (see Scope), so they cost next to nothing
+// however many variables there are.
+//
+// It can be saved as a binary image, in host byte order: "ISNP", a uint32_t
+// version, a uint32_t count, then for each named variable in slot order a
+// uint32_t name length, the name, a uint8_t Value::Kind and 8 bytes of
+// int64_t or double (zero if it has no value), then a uint8_t that's 1 if
+// the script follows as a uint32_t file name length, the file name, a
+// uint64_t length and the script.
+class Snapshot
+{
+public:
+  Snapshot() : program(false) {};
+  Snapshot(const Scope& s) : scope(s), program(false) {};
+  // with the script the variables came from
+  Snapshot(const Scope& s, const std::string& src, const std::string& f) : scope(s), program(true), source(src), file(f) {};
+  ~Snapshot() {};
+
+  inline const Scope& getScope() const { return scope; };
+  // whether it has the script
+  inline bool hasProgram() const { return program; };
+  inline const std::string& getSource() const { return source; };
+  inline const std::string& getFile() const { return file; };
+
+  std::string image() const
+  {
+    std::string buffer = "ISNP";
+    raw(buffer, VERSION);
+    raw(buffer, static_cast<uint32_t>(scope.getNames().size()));
+
+    // blocks' variables have no names, and are gone once the block's done
+    std::vector<const std::string*> names(scope.size());
+    for (auto&& it : scope.getNames())
+      names[it.second] = &it.first;
+    for (uint32_t slot = 0; slot < scope.size(); ++slot)
+    {
+      if (!names[slot])
+        continue;
+      const Value v = scope.get(slot);
+      raw(buffer, static_cast<uint32_t>(names[slot]->length()));
+      buffer += *names[slot];
+      buffer += static_cast<char>(v.getKind());
+      if (v.isReal())
+        raw(buffer, v.toReal());
+      else
+        raw(buffer, v.isInt() ? v.toInt() : static_cast<int64_t>(0));
+    }
+
+    buffer += static_cast<char>(program ? 1 : 0);
+    if (program)
+    {
+      raw(buffer, static_cast<uint32_t>(file.length()));
+      buffer += file;
+      raw(buffer, static_cast<uint64_t>(source.length()));
+      buffer += source;
+    }
+    return buffer;
+  }
+
+  static Snapshot fromImage(const std::string& image)
+  {
+    Reader in(image);
+    if (image.compare(0, 4, "ISNP") != 0)
+      throw std::string("Snapshot: not a snapshot");
+    in.pos = 4;
+    if (in.get<uint32_t>() != VERSION)
+      throw std::string("Snapshot: unsupported version");
+
+    Snapshot s;
+    const uint32_t count = in.get<uint32_t>();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      const std::string name = in.take(in.get<uint32_t>());
+      const uint8_t kind = in.get<uint8_t>();
+      const uint32_t slot = s.scope.declare(name);
+      if (slot != i)
+        throw std::string("Snapshot: bad image");
+      switch (kind)
+      {
+        case Value::Kind::NONE:
+          in.get<int64_t>();
+        break;
+        case Value::Kind::INT:
+          s.scope.set(slot, Value(in.get<int64_t>()));
+        break;
+        case Value::Kind::REAL:
+          s.scope.set(slot, Value(in.get<double>()));
+        break;
+        default:
+          throw std::string("Snapshot: bad image");
+      }
+    }
+
+    s.program = in.get<uint8_t>() != 0;
+    if (s.program)
+    {
+      s.file = in.take(in.get<uint32_t>());
+      s.source = in.take(in.get<uint64_t>());
+    }
+    return s;
+  }
+
+  void save(const std::string& path) const
+  {
+    const std::string buffer = image();
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.length()));
+    if (!out.good())
+      throw std::string("Snapshot: failed to write ") + path;
+  }
+
+  static Snapshot load(const std::string& path)
+  {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in.is_open())
+      throw std::string("Snapshot: failed to read ") + path;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return fromImage(ss.str());
+  }
+
+private:
+  static constexpr uint32_t VERSION = 1;
+
+  // reads an image, failing rather than going off the end of it
+  struct Reader
+  {
+    Reader(const std::string& i) : image(i), pos(0) {};
+
+    std::string take(const uint64_t n)
+    {
+      if (n > image.length() - pos)
+        throw std::string("Snapshot: truncated image");
+      const std::string s = image.substr(pos, n);
+      pos += n;
+      return s;
+    }
+
+    template <typename T>
+    T get()
+    {
+      const std::string bytes = take(sizeof(T));
+      T v;
+      std::memcpy(&v, bytes.data(), sizeof(T));
+      return v;
+    }
+
+    const std::string& image;
+    std::string::size_type pos;
+  };
+
+  template <typename T>
+  static void raw(std::string& buffer, const T& v)
+  {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &v, sizeof(T));
+    buffer.append(bytes, sizeof(T));
+  }
+
+  Scope scope;
+  bool program;
+  std::string source;
+  std::string file;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef THREADPOOL_H_INCLUDE
+#define THREADPOOL_H_INCLUDE
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads pulling jobs off a shared queue.
+class ThreadPool
+{
+public:
+  ThreadPool(uint32_t n) : pending(0), stopping(false)
+  {
+    if (n == 0)
+      n = 1;
+    for (uint32_t i = 0; i < n; ++i)
+      workers.emplace_back([this]() { work(); });
+  };
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    available.notify_all();
+    for (std::thread& t : workers)
+      t.join();
+  };
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  inline uint32_t size() const { return static_cast<uint32_t>(workers.size()); };
+
+  // the number of threads to use when asked for `n`, where 0 means one per core
+  static uint32_t threads(const uint32_t n)
+  {
+    if (n)
+      return n;
+    const uint32_t cores = std::thread::hardware_concurrency();
+    return cores ? cores : 1;
+  }
+
+  // jobs must not throw, catch and report errors through what they capture
+  void submit(std::function<void()> job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+      ++pending;
+    }
+    available.notify_one();
+  }
+
+  // blocks until every submitted job has finished
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return pending == 0; });
+  }
+
+private:
+  void work()
+  {
+    for (;;)
+    {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+          return;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+          finished.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable finished;
+  uint64_t pending;
+  bool stopping;
+};
+
+#endif
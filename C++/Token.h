@@ -4,6 +4,9 @@
 #include <sstream>
 #include <string>
 
+#include "Arena.h"
+#include "Value.h"
+
 class Token
 {
 public:
@@ -29,7 +32,16 @@ public:
     BLOCK_END      =0x20000,
     SEMICOLON      =0x40000,
     ID             =0x80000,
-    ASSIGN         =0x100000
+    ASSIGN         =0x100000,
+    COMMA          =0x200000,
+    LESS           =0x400000,
+    GREATER        =0x800000,
+    LESS_EQUAL     =0x1000000,
+    GREATER_EQUAL  =0x2000000,
+    EQUAL          =0x4000000,
+    NOT_EQUAL      =0x8000000,
+    WHILE          =0x10000000,
+    FOR            =0x20000000
   };
 
   static std::string fromType(const Token::Type& t)
@@ -78,6 +90,24 @@ public:
         return "ID";
       case ASSIGN:
         return "=";
+      case COMMA:
+        return ",";
+      case LESS:
+        return "<";
+      case GREATER:
+        return ">";
+      case LESS_EQUAL:
+        return "<=";
+      case GREATER_EQUAL:
+        return ">=";
+      case EQUAL:
+        return "==";
+      case NOT_EQUAL:
+        return "!=";
+      case WHILE:
+        return "while";
+      case FOR:
+        return "for";
     }
     return "??";
   }
@@ -86,7 +116,11 @@ public:
   Token() {};
   virtual ~Token() {};
 
+  static void* operator new(std::size_t n) { return Arena::create(n); };
+  static void operator delete(void* p) { Arena::destroy(p); };
+
   virtual Token::Type getType() const = 0;
+  virtual Token* clone() const = 0;
 
   template <typename T>
   friend std::ostream& operator<<(std::ostream& os, const Token& t)
@@ -109,23 +143,25 @@ public:
   virtual ~TokenEOF() {};
 
   virtual Token::Type getType() const { return END_OF_FILE; };
+  virtual Token* clone() const { return new TokenEOF(*this); };
 };
 
 
 class TokenNumber : public Token
 {
 public:
-  TokenNumber(const double v) : value(v) {};
+  TokenNumber(const Value& v) : value(v) {};
   virtual ~TokenNumber() {};
 
   virtual Token::Type getType() const { return NUMBER; };
-  inline const double& getValue() const { return value; };
+  virtual Token* clone() const { return new TokenNumber(*this); };
+  inline const Value& getValue() const { return value; };
 private:
   virtual void print(std::ostream& os) const
   {
     os << "Token(" << fromType(getType()) << ", " << value << ")";
   }
-  double value;
+  Value value;
 };
 
 class TokenAddition : public Token
@@ -135,6 +171,7 @@ public:
   virtual ~TokenAddition() {};
 
   virtual Token::Type getType() const { return ADDITION; };
+  virtual Token* clone() const { return new TokenAddition(*this); };
 };
 
 class TokenSubtraction : public Token
@@ -144,6 +181,7 @@ public:
   virtual ~TokenSubtraction() {};
 
   virtual Token::Type getType() const { return SUBTRACTION; };
+  virtual Token* clone() const { return new TokenSubtraction(*this); };
 };
 
 class TokenMultiplication : public Token
@@ -153,6 +191,7 @@ public:
   virtual ~TokenMultiplication() {};
 
   virtual Token::Type getType() const { return MULTIPLICATION; };
+  virtual Token* clone() const { return new TokenMultiplication(*this); };
 };
 
 class TokenDivision : public Token
@@ -162,6 +201,7 @@ public:
   virtual ~TokenDivision() {};
 
   virtual Token::Type getType() const { return DIVISION; };
+  virtual Token* clone() const { return new TokenDivision(*this); };
 };
 
 class TokenModulo : public Token
@@ -171,6 +211,7 @@ public:
   virtual ~TokenModulo() {};
 
   virtual Token::Type getType() const { return MODULO; };
+  virtual Token* clone() const { return new TokenModulo(*this); };
 };
 
 class TokenPower : public Token
@@ -180,6 +221,7 @@ public:
   virtual ~TokenPower() {};
 
   virtual Token::Type getType() const { return POWER; };
+  virtual Token* clone() const { return new TokenPower(*this); };
 };
 
 class TokenBitwiseAND : public Token
@@ -189,6 +231,7 @@ public:
   virtual ~TokenBitwiseAND() {};
 
   virtual Token::Type getType() const { return BITWISE_AND; };
+  virtual Token* clone() const { return new TokenBitwiseAND(*this); };
 };
 
 class TokenBitwiseOR : public Token
@@ -198,6 +241,7 @@ public:
   virtual ~TokenBitwiseOR() {};
 
   virtual Token::Type getType() const { return BITWISE_OR; };
+  virtual Token* clone() const { return new TokenBitwiseOR(*this); };
 };
 
 class TokenBitwiseNOT : public Token
@@ -207,6 +251,7 @@ public:
   virtual ~TokenBitwiseNOT() {};
 
   virtual Token::Type getType() const { return BITWISE_NOT; };
+  virtual Token* clone() const { return new TokenBitwiseNOT(*this); };
 };
 
 class TokenBitwiseXOR : public Token
@@ -216,6 +261,7 @@ public:
   virtual ~TokenBitwiseXOR() {};
 
   virtual Token::Type getType() const { return BITWISE_XOR; };
+  virtual Token* clone() const { return new TokenBitwiseXOR(*this); };
 };
 
 class TokenBitshiftL : public Token
@@ -225,6 +271,7 @@ public:
   virtual ~TokenBitshiftL() {};
 
   virtual Token::Type getType() const { return BITSHIFT_L; };
+  virtual Token* clone() const { return new TokenBitshiftL(*this); };
 };
 
 class TokenBitshiftR : public Token
@@ -234,6 +281,7 @@ public:
   virtual ~TokenBitshiftR() {};
 
   virtual Token::Type getType() const { return BITSHIFT_R; };
+  virtual Token* clone() const { return new TokenBitshiftR(*this); };
 };
 
 class TokenParenthesisL : public Token
@@ -243,6 +291,7 @@ public:
   virtual ~TokenParenthesisL() {};
 
   virtual Token::Type getType() const { return PARENTHESIS_L; };
+  virtual Token* clone() const { return new TokenParenthesisL(*this); };
 };
 
 class TokenParenthesisR : public Token
@@ -252,6 +301,7 @@ public:
   virtual ~TokenParenthesisR() {};
 
   virtual Token::Type getType() const { return PARENTHESIS_R; };
+  virtual Token* clone() const { return new TokenParenthesisR(*this); };
 };
 
 class TokenBlockBegin : public Token
@@ -261,6 +311,7 @@ public:
   virtual ~TokenBlockBegin() {};
 
   virtual Token::Type getType() const { return BLOCK_BEGIN; };
+  virtual Token* clone() const { return new TokenBlockBegin(*this); };
 };
 
 class TokenBlockEnd : public Token
@@ -270,6 +321,7 @@ public:
   virtual ~TokenBlockEnd() {};
 
   virtual Token::Type getType() const { return BLOCK_END; };
+  virtual Token* clone() const { return new TokenBlockEnd(*this); };
 };
 
 class TokenSemicolon : public Token
@@ -279,6 +331,7 @@ public:
   virtual ~TokenSemicolon() {};
 
   virtual Token::Type getType() const { return SEMICOLON; };
+  virtual Token* clone() const { return new TokenSemicolon(*this); };
 };
 
 class TokenID : public Token
@@ -288,6 +341,7 @@ public:
   ~TokenID() {};
 
   virtual Token::Type getType() const { return ID; };
+  virtual Token* clone() const { return new TokenID(*this); };
   const std::string& getName() const { return name; };
 private:
   virtual void print(std::ostream& os) const
@@ -305,6 +359,97 @@ public:
   virtual ~TokenAssign() {};
 
   virtual Token::Type getType() const { return ASSIGN; };
+  virtual Token* clone() const { return new TokenAssign(*this); };
+};
+
+class TokenComma : public Token
+{
+public:
+  TokenComma() {};
+  virtual ~TokenComma() {};
+
+  virtual Token::Type getType() const { return COMMA; };
+  virtual Token* clone() const { return new TokenComma(*this); };
+};
+
+class TokenLess : public Token
+{
+public:
+  TokenLess() {};
+  virtual ~TokenLess() {};
+
+  virtual Token::Type getType() const { return LESS; };
+  virtual Token* clone() const { return new TokenLess(*this); };
+};
+
+class TokenGreater : public Token
+{
+public:
+  TokenGreater() {};
+  virtual ~TokenGreater() {};
+
+  virtual Token::Type getType() const { return GREATER; };
+  virtual Token* clone() const { return new TokenGreater(*this); };
+};
+
+class TokenLessEqual : public Token
+{
+public:
+  TokenLessEqual() {};
+  virtual ~TokenLessEqual() {};
+
+  virtual Token::Type getType() const { return LESS_EQUAL; };
+  virtual Token* clone() const { return new TokenLessEqual(*this); };
+};
+
+class TokenGreaterEqual : public Token
+{
+public:
+  TokenGreaterEqual() {};
+  virtual ~TokenGreaterEqual() {};
+
+  virtual Token::Type getType() const { return GREATER_EQUAL; };
+  virtual Token* clone() const { return new TokenGreaterEqual(*this); };
+};
+
+class TokenEqual : public Token
+{
+public:
+  TokenEqual() {};
+  virtual ~TokenEqual() {};
+
+  virtual Token::Type getType() const { return EQUAL; };
+  virtual Token* clone() const { return new TokenEqual(*this); };
+};
+
+class TokenNotEqual : public Token
+{
+public:
+  TokenNotEqual() {};
+  virtual ~TokenNotEqual() {};
+
+  virtual Token::Type getType() const { return NOT_EQUAL; };
+  virtual Token* clone() const { return new TokenNotEqual(*this); };
+};
+
+class TokenWhile : public Token
+{
+public:
+  TokenWhile() {};
+  virtual ~TokenWhile() {};
+
+  virtual Token::Type getType() const { return WHILE; };
+  virtual Token* clone() const { return new TokenWhile(*this); };
+};
+
+class TokenFor : public Token
+{
+public:
+  TokenFor() {};
+  virtual ~TokenFor() {};
+
+  virtual Token::Type getType() const { return FOR; };
+  virtual Token* clone() const { return new TokenFor(*this); };
 };
 
 #endif
@@ -0,0 +1,224 @@
+#ifndef VALUE_H_INCLUDE
+#define VALUE_H_INCLUDE
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <string>
+
+// A tagged number: either an exact 64 bit integer or a double.
+// Integer arithmetic stays integral until it would overflow, at which point
+// it falls back to doubles, which is what every value used to be.
+class Value
+{
+public:
+  enum Kind
+  {
+    NONE = 0, // no value (or, when annotating the AST, not statically known)
+    INT,
+    REAL
+  };
+
+  static std::string fromKind(const Value::Kind& k)
+  {
+    switch (k)
+    {
+      case Value::NONE:
+        return "NONE";
+      case Value::INT:
+        return "INT";
+      case Value::REAL:
+        return "REAL";
+    }
+    return "??";
+  }
+
+  Value() : kind(NONE), i(0) {};
+  Value(const int64_t v) : kind(INT), i(v) {};
+  Value(const double v) : kind(REAL), d(v) {};
+
+  inline Value::Kind getKind() const { return kind; };
+  inline bool isInt() const { return kind == INT; };
+  inline bool isReal() const { return kind == REAL; };
+  inline bool isNone() const { return kind == NONE; };
+
+  // conversions use the same casts the interpreter always used, except that
+  // doubles outside int64_t's range (and NaN) give INT64_MIN, as they did on
+  // x86, rather than being undefined
+  inline int64_t toInt() const { return kind == INT ? i : truncate(d); };
+  inline double toReal() const { return kind == INT ? static_cast<double>(i) : d; };
+  // what conditions test: anything but zero
+  inline bool isTrue() const { return kind == INT ? i != 0 : d != 0.0; };
+
+  friend std::ostream& operator<<(std::ostream& os, const Value& v)
+  {
+    if (v.kind == INT)
+      os << v.i;
+    else
+      os << v.d;
+    return os;
+  }
+
+  static Value add(const Value& l, const Value& r)
+  {
+    int64_t res;
+    if (l.kind == INT && r.kind == INT && !__builtin_add_overflow(l.i, r.i, &res))
+      return Value(res);
+    return Value(l.toReal() + r.toReal());
+  }
+
+  static Value subtract(const Value& l, const Value& r)
+  {
+    int64_t res;
+    if (l.kind == INT && r.kind == INT && !__builtin_sub_overflow(l.i, r.i, &res))
+      return Value(res);
+    return Value(l.toReal() - r.toReal());
+  }
+
+  static Value multiply(const Value& l, const Value& r)
+  {
+    int64_t res;
+    if (l.kind == INT && r.kind == INT && !__builtin_mul_overflow(l.i, r.i, &res))
+      return Value(res);
+    return Value(l.toReal() * r.toReal());
+  }
+
+  // division stays integral only when it is exact
+  static Value divide(const Value& l, const Value& r)
+  {
+    if (l.kind == INT && r.kind == INT && r.i != 0 &&
+        !(l.i == std::numeric_limits<int64_t>::min() && r.i == -1) &&
+        l.i % r.i == 0)
+      return Value(l.i / r.i);
+    return Value(l.toReal() / r.toReal());
+  }
+
+  // integers raised to non-negative integers stay exact, everything else is
+  // std::pow
+  static Value power(const Value& l, const Value& r)
+  {
+    int64_t res;
+    if (l.kind == INT && r.kind == INT && r.i >= 0 && powerInteger(l.i, r.i, res))
+      return Value(res);
+    return Value(std::pow(l.toReal(), r.toReal()));
+  }
+
+  // exponentiation by squaring, false if it overflowed
+  static bool powerInteger(int64_t b, int64_t e, int64_t& res)
+  {
+    res = 1;
+    while (e)
+    {
+      if ((e & 1) && __builtin_mul_overflow(res, b, &res))
+        return false;
+      e >>= 1;
+      if (e && __builtin_mul_overflow(b, b, &b))
+        return false;
+    }
+    return true;
+  }
+
+  // Kernels for constant exponents. square and reciprocal are a single
+  // correctly rounded operation, so they agree with std::pow(x, e).
+  static Value square(const Value& v)
+  {
+    return multiply(v, v);
+  }
+
+  static Value reciprocal(const Value& v)
+  {
+    return Value(1.0 / v.toReal());
+  }
+
+  // std::sqrt is correctly rounded where std::pow(x, 0.5) isn't always, so
+  // this may differ in the last bit; it also differs for -0 and -inf
+  static Value squareRoot(const Value& v)
+  {
+    const double x = v.toReal();
+    if (x == -std::numeric_limits<double>::infinity())
+      return Value(std::numeric_limits<double>::infinity());
+    return Value(std::sqrt(x) + 0.0);
+  }
+
+  // x ** n for a constant integer n. Without strict floating point, doubles
+  // use repeated squaring too, which may differ from std::pow in the last bit.
+  static Value powerConstant(const Value& v, const int64_t n, const bool strictFP)
+  {
+    if (v.kind == INT)
+      return power(v, Value(n));
+    if (strictFP)
+      return Value(std::pow(v.d, static_cast<double>(n)));
+
+    uint64_t e = n < 0 ? -static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+    double b = v.d;
+    double res = 1.0;
+    while (e)
+    {
+      if (e & 1)
+        res *= b;
+      e >>= 1;
+      if (e)
+        b *= b;
+    }
+    return Value(n < 0 ? 1.0 / res : res);
+  }
+
+  static Value negate(const Value& v)
+  {
+    if (v.kind == INT && v.i != std::numeric_limits<int64_t>::min())
+      return Value(-v.i);
+    return Value(-v.toReal());
+  }
+
+  static inline int64_t truncate(const double v)
+  {
+    if (v >= -9223372036854775808.0 && v < 9223372036854775808.0)
+      return static_cast<int64_t>(v);
+    return std::numeric_limits<int64_t>::min();
+  }
+
+  // the integer operators, on values already cast to int64_t
+  static inline int64_t modulo(const int64_t l, const int64_t r)
+  {
+    if (r == 0)
+      throw std::string("Interpreter: modulo by zero");
+    if (r == -1)
+      return 0; // INT64_MIN % -1 traps
+    return l % r;
+  }
+  static inline int64_t bitwiseAnd(const int64_t l, const int64_t r) { return l & r; };
+  static inline int64_t bitwiseOr(const int64_t l, const int64_t r) { return l | r; };
+  static inline int64_t bitwiseXor(const int64_t l, const int64_t r) { return l ^ r; };
+  static inline int64_t bitwiseNot(const int64_t v) { return ~v; };
+  // shift counts are taken mod 64, as x86 always did with them
+  static inline int64_t shiftLeft(const int64_t l, const int64_t r)
+  {
+    return static_cast<int64_t>(static_cast<uint64_t>(l) << (r & 63));
+  }
+  static inline int64_t shiftRight(const int64_t l, const int64_t r) { return l >> (r & 63); };
+
+  // comparisons, integers are compared exactly rather than as doubles
+  static inline bool less(const Value& l, const Value& r)
+  {
+    return l.kind == INT && r.kind == INT ? l.i < r.i : l.toReal() < r.toReal();
+  }
+  static inline bool lessEqual(const Value& l, const Value& r)
+  {
+    return l.kind == INT && r.kind == INT ? l.i <= r.i : l.toReal() <= r.toReal();
+  }
+  static inline bool equal(const Value& l, const Value& r)
+  {
+    return l.kind == INT && r.kind == INT ? l.i == r.i : l.toReal() == r.toReal();
+  }
+
+private:
+  Kind kind;
+  union
+  {
+    int64_t i;
+    double d;
+  };
+};
+
+#endif
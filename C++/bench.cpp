@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Interpreter.h"
+
+// Times the evaluator over a generated script made of the small expression
+// shapes our workloads are full of.
+
+std::string generate(const int32_t statements)
+{
+  std::stringstream ss;
+  ss << "{\n  x = 3;\n  y = 4.5;\n  z = 7;\n";
+  for (int32_t i = 0; i < statements; ++i)
+  {
+    ss << "  a" << i % 16 << " = x * y + z;\n";
+    ss << "  b" << i % 16 << " = a" << i % 16 << " - 2;\n";
+    ss << "  c" << i % 16 << " = x * b" << i % 16 << ";\n";
+    ss << "  d" << i % 16 << " = (y + z) * 3 & 255;\n";
+  }
+  ss << "}\n";
+  return ss.str();
+}
+
+// the same iterative computation as a loop, and unrolled the way generators
+// had to write it without one
+std::string generateLoop(const int32_t iterations)
+{
+  std::stringstream ss;
+  ss << "{\n  n = 20;\n  s = 0;\n  t = 0.5;\n";
+  ss << "  for (i = 0; i < " << iterations << "; i = i + 1)\n  {\n";
+  ss << "    s = s + i * 3 + n * n;\n    t = t + (n + 1) * 0.5;\n  }\n}\n";
+  return ss.str();
+}
+
+std::string generateUnrolled(const int32_t iterations)
+{
+  std::stringstream ss;
+  ss << "{\n  n = 20;\n  s = 0;\n  t = 0.5;\n";
+  for (int32_t i = 0; i < iterations; ++i)
+  {
+    ss << "  s = s + " << i << " * 3 + n * n;\n";
+    ss << "  t = t + (n + 1) * 0.5;\n";
+  }
+  ss << "}\n";
+  return ss.str();
+}
+
+// generated code wrapping each step in a block of temporaries of its own
+std::string generateBlocks(const int32_t blocks)
+{
+  std::stringstream ss;
+  ss << "{\n  x = 3;\n  total = 0;\n";
+  for (int32_t i = 0; i < blocks; ++i)
+  {
+    ss << "  {\n    t" << i << " = x * " << i << ";\n    u" << i << " = t" << i << " + 1.5;\n";
+    ss << "    total = total + u" << i << ";\n  }\n";
+  }
+  ss << "}\n";
+  return ss.str();
+}
+
+// times compiling and running a script `runs` times
+double benchScript(const std::string& script, const int32_t runs, const Interpreter::Tiering& tiering = Interpreter::Tiering())
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < runs; ++i)
+  {
+    Interpreter interpreter(new Parser(new Lexer(script, "bench")), Optimizer::Options(), 1, tiering);
+    interpreter.compile();
+    interpreter.run();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+}
+
+// times reading and parsing a file `runs` times, one stage after another or
+// pipelined
+double benchParse(const std::string& file, const int32_t runs, const bool pipelined)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < runs; ++i)
+  {
+    Parser* parser;
+    if (pipelined)
+      parser = new Parser(new Pipeline(file));
+    else
+    {
+      std::ifstream in(file.c_str(), std::ios::binary);
+      std::stringstream ss;
+      ss << in.rdbuf();
+      parser = new Parser(new Lexer(ss.str(), file));
+    }
+    AST* tree = parser->parse();
+    delete tree;
+    delete parser;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+}
+
+double median(std::vector<double> times)
+{
+  std::sort(std::begin(times), std::end(times));
+  const std::vector<double>::size_type n = times.size();
+  return n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+}
+
+// times `runs` evaluations of an already compiled program
+double bench(Interpreter& interpreter, const int32_t runs)
+{
+  interpreter.run(); // warm up
+
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < runs; ++i)
+    interpreter.run();
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+}
+
+int main(int argc, char** argv)
+{
+  int32_t statements = argc > 1 ? std::stoi(argv[1]) : 2500;
+  int32_t runs = argc > 2 ? std::stoi(argv[2]) : 50;
+  const std::string script = generate(statements);
+
+  try
+  {
+    // steady state, so everything is optimized up front
+    Interpreter::Tiering eager;
+    eager.enabled = false;
+    Optimizer::Options plain;
+    plain.fuse = false;
+    Optimizer::Options fused;
+    Optimizer::Options fast;
+    fast.strictFP = false;
+
+    // compile everything up front so no tree is built from a fragmented heap
+    Interpreter unfusedInterpreter(new Parser(new Lexer(script, "bench")), plain, 1, eager);
+    Interpreter fusedInterpreter(new Parser(new Lexer(script, "bench")), fused, 1, eager);
+    Interpreter fastInterpreter(new Parser(new Lexer(script, "bench")), fast, 1, eager);
+    unfusedInterpreter.compile();
+    fusedInterpreter.compile();
+    fastInterpreter.compile();
+
+    // with fuel and time to count but never run out of
+    Budget generous;
+    generous.fuel = UINT64_MAX / 2;
+    generous.milliseconds = 3600 * 1000;
+    Interpreter budgetedInterpreter(new Parser(new Lexer(script, "bench")), fused, 1, eager);
+    budgetedInterpreter.setBudget(generous);
+    budgetedInterpreter.compile();
+
+    // publishing every assignment for readers on other threads
+    Interpreter publishingInterpreter(new Parser(new Lexer(script, "bench")), fused, 1, eager);
+    publishingInterpreter.compile();
+    const std::shared_ptr<const Published> published = publishingInterpreter.publish();
+
+    double base = bench(unfusedInterpreter, runs);
+    double f = bench(fusedInterpreter, runs);
+    double ff = bench(fastInterpreter, runs);
+    std::cout << "unfused: " << base << " ms/run\n";
+    std::cout << "fused: " << f << " ms/run\n";
+    std::cout << "fused (fast-math): " << ff << " ms/run\n";
+    std::cout << "speedup: " << base / f << "x, " << base / ff << "x (fast-math)\n";
+
+    // The difference is smaller than the noise of one timing, so each round
+    // times the budgeted interpreter against the unbudgeted one right next to
+    // it, alternating which goes first, and the median of the rounds is
+    // what's reported, with how far the rounds spread.
+    const int32_t rounds = 15;
+    std::vector<double> unmeteredTimes;
+    std::vector<double> meteredTimes;
+    std::vector<double> overheads;
+    for (int32_t i = 0; i < rounds; ++i)
+    {
+      double u, m;
+      if (i % 2)
+      {
+        m = bench(budgetedInterpreter, runs);
+        u = bench(fusedInterpreter, runs);
+      }
+      else
+      {
+        u = bench(fusedInterpreter, runs);
+        m = bench(budgetedInterpreter, runs);
+      }
+      unmeteredTimes.push_back(u);
+      meteredTimes.push_back(m);
+      overheads.push_back((m / u - 1) * 100);
+    }
+    const double unmetered = median(unmeteredTimes);
+    std::cout << "fused with a budget: " << median(meteredTimes) << " ms/run against " << unmetered << " ms/run ("
+              << median(overheads) << "% median overhead over " << rounds << " rounds, "
+              << *std::min_element(std::begin(overheads), std::end(overheads)) << "% to "
+              << *std::max_element(std::begin(overheads), std::end(overheads)) << "%)\n";
+
+    // writes, then reads with nothing writing, then both at once
+    {
+      double publishing = bench(publishingInterpreter, runs);
+      for (int32_t i = 0; i < 3; ++i)
+        publishing = std::min(publishing, bench(publishingInterpreter, runs));
+      const double assignments = statements * 4.0 + 3;
+      std::cout << "fused, publishing: " << publishing << " ms/run (" << (publishing / unmetered - 1) * 100 << "% overhead, "
+                << assignments / publishing / 1000 << "M writes/s)\n";
+
+      std::atomic<bool> stop(false);
+      std::atomic<uint64_t> reads(0);
+      auto read = [&]() {
+        uint64_t n = 0;
+        double sum = 0;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          for (uint32_t slot = 0; slot < published->size(); ++slot)
+            sum += published->get(slot).toReal();
+          n += published->size();
+        }
+        reads += n + (sum == 0.5 ? 1 : 0); // so the reads aren't optimized away
+      };
+
+      auto start = std::chrono::steady_clock::now();
+      std::thread idle(read);
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      stop = true;
+      idle.join();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "published reads: " << reads / seconds / 1e6 << "M reads/s\n";
+
+      stop = false;
+      reads = 0;
+      start = std::chrono::steady_clock::now();
+      std::thread reader(read);
+      const double contended = bench(publishingInterpreter, runs);
+      stop = true;
+      reader.join();
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "published reads while running: " << reads / seconds / 1e6 << "M reads/s, "
+                << contended << " ms/run (" << std::thread::hardware_concurrency() << " cores)\n";
+    }
+
+    try
+    {
+      Interpreter nativeInterpreter(new Parser(new Lexer(script, "bench")), plain, 1, eager);
+      nativeInterpreter.compile();
+      nativeInterpreter.compileNative("./bench-native.so");
+      double n = bench(nativeInterpreter, runs);
+      std::cout << "native: " << n << " ms/run (" << base / n << "x)\n";
+    }
+    catch (std::string error)
+    {
+      std::cout << "native: " << error << "\n";
+    }
+    std::remove("./bench-native.so");
+
+    double once = benchScript(script, runs, eager);
+    double onceTiered = benchScript(script, runs);
+    std::cout << "compile and run once, optimized first: " << once << " ms/run\n";
+    std::cout << "compile and run once, tiered: " << onceTiered << " ms/run\n";
+
+    double unrolled = benchScript(generateUnrolled(statements * 4), runs);
+    double loop = benchScript(generateLoop(statements * 4), runs);
+    std::cout << "unrolled (compile and run): " << unrolled << " ms/run\n";
+    std::cout << "loop (compile and run): " << loop << " ms/run\n";
+    std::cout << "speedup: " << unrolled / loop << "x\n";
+
+    // a variation run after the script, from scratch and forked from a
+    // snapshot of the script's variables
+    {
+      const std::string variation = "  e = a0 * x + d3;\n}\n";
+      const std::string whole = script.substr(0, script.length() - 2) + variation;
+      Interpreter setup(new Parser(new Lexer(script, "bench")), fused, 1, eager);
+      setup.compile();
+      setup.run();
+      const Snapshot snapshot = setup.snapshot();
+
+      const int32_t forks = runs * 100;
+      auto start = std::chrono::steady_clock::now();
+      for (int32_t i = 0; i < forks; ++i)
+      {
+        Interpreter fork(new Parser(new Lexer("{\n" + variation, "bench")), fused, 1, eager);
+        fork.restore(snapshot);
+        fork.compile();
+        fork.run();
+      }
+      auto end = std::chrono::steady_clock::now();
+      double forked = std::chrono::duration<double, std::milli>(end - start).count() / forks;
+      double scratch = benchScript(whole, runs, eager);
+      std::cout << "variation from scratch: " << scratch << " ms/run\n";
+      std::cout << "variation forked from a snapshot: " << forked * 1000 << " us/run (" << scratch / forked << "x)\n";
+    }
+
+    // temporaries in blocks, scoped to them and all global
+    {
+      const std::string blocks = generateBlocks(statements * 4);
+      for (const bool global : {false, true})
+      {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t slots = 0;
+        for (int32_t i = 0; i < runs; ++i)
+        {
+          Interpreter interpreter(new Parser(new Lexer(blocks, "bench")), fused, 1, eager);
+          interpreter.setGlobalScope(global);
+          interpreter.compile();
+          interpreter.run();
+          slots = interpreter.getScope().size();
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "blocks (compile and run" << (global ? ", global scope" : "") << "): "
+                  << std::chrono::duration<double, std::milli>(end - start).count() / runs << " ms/run, " << slots << " slots\n";
+      }
+    }
+
+    {
+      std::ofstream out("./bench-parse.txt");
+      out << generate(statements * 40);
+    }
+    double serial = benchParse("./bench-parse.txt", 5, false);
+    double pipelined = benchParse("./bench-parse.txt", 5, true);
+    std::remove("./bench-parse.txt");
+    std::cout << "read and parse: " << serial << " ms/run\n";
+    std::cout << "read and parse (pipelined): " << pipelined << " ms/run\n";
+    std::cout << "speedup: " << serial / pipelined << "x\n";
+  }
+  catch (std::string error)
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,11 +1,16 @@
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <string>
+#include <vector>
 
+#include "Batch.h"
 #include "Token.h"
 #include "Parser.h"
 #include "Lexer.h"
 #include "Interpreter.h"
+#include "Output.h"
 
 void getInputFromStdIn(std::string& script)
 {
@@ -30,23 +35,195 @@ void readScript(std::string& script, std::string const& filename)
   }
 }
 
+// runs a script both natively compiled and interpreted, with the same options,
+// checking that every variable ends up with the same kind and bits, or both
+// fail the same way
+bool verifyNative(const std::string& script, const std::string& file, const std::string& path, const Optimizer::Options& options, const Interpreter::Tiering& tiering, const bool global)
+{
+  Interpreter native(new Parser(new Lexer(script, file)), options, 1, tiering);
+  Interpreter interpreted(new Parser(new Lexer(script, file)), options, 1, tiering);
+  native.setGlobalScope(global);
+  interpreted.setGlobalScope(global);
+  native.compile();
+  native.compileNative(path);
+  interpreted.compile();
+
+  std::string nativeError;
+  std::string interpretedError;
+  try { native.run(); } catch (std::string e) { nativeError = e; }
+  try { interpreted.run(); } catch (std::string e) { interpretedError = e; }
+  if (nativeError != interpretedError)
+  {
+    std::cerr << "aot-verify: native failed with \"" << nativeError << "\", interpreted with \"" << interpretedError << "\"" << std::endl;
+    return false;
+  }
+
+  bool same = true;
+  for (auto&& it : interpreted.getScope().getNames())
+  {
+    const Value a = interpreted.getScope().get(it.second);
+    const Value b = native.get(it.first);
+    const double x = a.toReal();
+    const double y = b.toReal();
+    const bool equal = a.getKind() == b.getKind() &&
+      (a.isInt() ? a.toInt() == b.toInt() : std::memcmp(&x, &y, sizeof(double)) == 0);
+    if (!equal)
+    {
+      std::cerr << "aot-verify: " << it.first << " is " << b << " native, " << a << " interpreted" << std::endl;
+      same = false;
+    }
+  }
+  if (same)
+    std::cerr << "aot-verify: " << interpreted.getScope().getNames().size() << " variables match" << std::endl;
+  return same;
+}
+
 int main(int argc, char** argv)
 {
   std::string file;
-  if (argc > 1)
-    file = std::string(argv[1]);
+  Optimizer::Options options;
+  Interpreter::Tiering tiering;
+  uint32_t parseThreads = 1;
+  uint32_t threads = 1;
+  Output::Format format = Output::TEXT;
+  std::vector<std::string> outputs;
+  std::string aot;
+  bool verify = false;
+  std::string batch;
+  uint32_t jobs = 0;
+  bool pipelined = false;
+  std::string snapshot;
+  std::string restore;
+  Budget budget;
+  bool global = false;
+  bool parseStats = false;
+  bool inferStats = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg(argv[i]);
+    if (arg == "--fast-math")
+      options.strictFP = false;
+    else if (arg == "--no-tiering")
+      tiering.enabled = false;
+    else if (arg == "--aot" && i + 1 < argc)
+      aot = argv[++i];
+    else if (arg == "--aot-verify")
+      verify = true;
+    else if (arg == "--batch" && i + 1 < argc)
+      batch = argv[++i];
+    else if (arg == "--jobs" && i + 1 < argc)
+      jobs = std::stoul(argv[++i]);
+    else if (arg == "--snapshot" && i + 1 < argc)
+      snapshot = argv[++i];
+    else if (arg == "--restore" && i + 1 < argc)
+      restore = argv[++i];
+    else if (arg == "--fuel" && i + 1 < argc)
+      budget.fuel = std::stoull(argv[++i]);
+    else if (arg == "--memory" && i + 1 < argc)
+      budget.memory = std::stoull(argv[++i]);
+    else if (arg == "--timeout" && i + 1 < argc)
+      budget.milliseconds = std::stoull(argv[++i]);
+    else if (arg == "--max-nesting" && i + 1 < argc)
+      budget.nesting = std::stoul(argv[++i]);
+    else if (arg == "--global-scope")
+      global = true;
+    else if (arg == "--pipeline")
+      pipelined = true;
+    else if (arg == "--parse-threads" && i + 1 < argc)
+      parseThreads = std::stoul(argv[++i]);
+    else if (arg == "--parse-stats")
+      parseStats = true;
+    else if (arg == "--infer-stats")
+      inferStats = true;
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoul(argv[++i]);
+    else if (arg == "--format" && i + 1 < argc)
+    {
+      if (!Output::fromName(argv[++i], format))
+      {
+        std::cerr << "unknown format: " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--output" && i + 1 < argc)
+    {
+      std::stringstream ss(argv[++i]);
+      std::string name;
+      while (std::getline(ss, name, ','))
+        outputs.push_back(name);
+    }
+    else
+      file = arg;
+  }
+
+  // a directory of scripts, or a file listing them, each run independently
+  if (batch.length())
+  {
+    try
+    {
+      Batch runner(Batch::list(batch), Output(format, outputs), jobs, options, tiering, budget, global);
+      return runner.run() ? 1 : 0;
+    }
+    catch (std::string error)
+    {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+  }
 
   Interpreter* interpreter = nullptr;
+  int status = 0;
   try
   {
-    std::string script;
-    if (file.length() == 0)
-      getInputFromStdIn(script);
+    if (restore.length() && file.length() == 0)
+    {
+      // carry on with the snapshot's own script
+      interpreter = new Interpreter(Snapshot::load(restore), options, threads, tiering);
+    }
+    else if (pipelined && file.length() && !verify)
+    {
+      // reading, lexing and parsing a file at once, see Pipeline
+      interpreter = new Interpreter(new Parser(new Pipeline(file)), options, threads, tiering);
+    }
     else
-      readScript(script, file);
+    {
+      std::string script;
+      if (file.length() == 0)
+        getInputFromStdIn(script);
+      else
+        readScript(script, file);
 
-    interpreter = new Interpreter(new Parser(new Lexer(script, file)));
-    interpreter->interpret();
+      if (verify)
+        return verifyNative(script, file, aot.length() ? aot : "./aot-verify.so", options, tiering, global) ? 0 : 1;
+
+      interpreter = new Interpreter(new Parser(new Lexer(script, file), parseThreads), options, threads, tiering);
+    }
+    // start from the variables of an earlier run
+    if (restore.length() && file.length())
+      interpreter->restore(Snapshot::load(restore));
+    interpreter->setBudget(budget);
+    interpreter->setGlobalScope(global);
+
+    if (aot.length())
+    {
+      interpreter->compile();
+      interpreter->compileNative(aot);
+      interpreter->run();
+      Output(format, outputs).write(interpreter->getScope());
+    }
+    else
+      interpreter->interpret(Output(format, outputs));
+    if (snapshot.length())
+      interpreter->snapshot(true).save(snapshot);
+    if (parseStats && interpreter->getParser())
+      std::cerr << "parsed ahead of time: " << interpreter->getParser()->getParsedAhead() << " blocks" << std::endl;
+    if (inferStats)
+      std::cerr << "integer operators: " << interpreter->getIntegers() << std::endl;
+  }
+  catch (Budget::Exceeded exceeded)
+  {
+    std::cerr << exceeded << std::endl;
+    status = 2;
   }
   catch (std::string error)
   {
@@ -54,5 +231,5 @@ int main(int argc, char** argv)
   }
   if (interpreter)
     delete interpreter;
-  return 0;
+  return status;
 }